@@ -4,6 +4,7 @@
 #include "ogp_debug_draw.h"
 #include "ogp_fx.h"
 #include "ogp_input.h"
+#include "ogp_jobs.h"
 #include "ogp_opengl.h"
 #include "ogp_messages.h"
 #include "ogp_models.h"
@@ -320,6 +321,8 @@ int main(int argc, char *argv[])
 
             if (key_just_pressed("P")) {
                 physics.debug_print_stats();
+                rc_game.debug_print_stats("game");
+                rc_hud.debug_print_stats("hud");
             }
 
             if (key_just_pressed("R")) {
@@ -362,7 +365,6 @@ int main(int argc, char *argv[])
         rc_game.draw_color_face({-10.0f, 0.0f, 10.0f}, {10.0f, 0.0f, 10.0f}, {-10.0f, 0.0f, -10.0f});
         rc_game.draw_color_face({-10.0f, 0.0f, -10.0f}, {10.0f, 0.0f, 10.0f}, {10.0f, 0.0f, -10.0f});
 
-        cloth.draw(&rc_game);
         box.draw(&rc_game);
         // pyramids.draw(&rc_game, frame_interpolation);
 
@@ -433,7 +435,18 @@ int main(int argc, char *argv[])
         if (o_debug_grid_3d) debug_grid_3d(&rc_game);
         if (o_debug_grid_2d) debug_grid_2d(&rc_hud);
 
-        if (o_debug_physics) physics.debug_draw(&rc_game, frame_interpolation);
+        // Cloth and physics overlay are recorded at once, each through its own recorder
+        rc_game.begin_recording();
+        jobs().run(2, [&](i32 task) {
+            render_recorder_t recorder = rc_game.recorder();
+            if (task == 0) {
+                cloth.draw(&recorder);
+            }
+            else if (o_debug_physics) {
+                physics.debug_draw(&recorder, frame_interpolation);
+            }
+        });
+        rc_game.end_recording();
         /*
          * if (console.enabled()) {
          *     console.draw(frame_interpolation);
@@ -1 +1,395 @@
 #include "ogp_array.h"
+
+#include <cstring>
+
+namespace ogp
+{
+
+slot_map_t::slot_map_t(char const *type_name, i32 capacity)
+    : m_type_name(type_name)
+    , m_capacity(capacity)
+    , m_slots(capacity)
+    , m_data_slots(capacity, -1)
+{
+    m_free_slots_indices.reserve(capacity);
+}
+
+bool slot_map_t::reserve_one()
+{
+    if (m_top_data < m_capacity) {
+        return true;
+    }
+
+    switch (m_growth) {
+    case growth_e::geometric:
+        enlarge(std::max(1, static_cast<i32>(m_capacity * (m_growth_amount - 1.0f))));
+        break;
+
+    case growth_e::fixed_step:
+        enlarge(std::max(1, static_cast<i32>(m_growth_amount)));
+        break;
+
+    case growth_e::hard_fail:
+        ogp_log_error("Array is full! %s %d / %d", m_type_name, m_top_data, m_capacity);
+        terminate("array_t is full");
+        break;
+    }
+
+    if (m_top_data >= m_capacity) {
+        ogp_log_warning("Max elements exceed in the array! %s %d / %d", m_type_name, m_top_data, m_capacity);
+        return false;
+    }
+
+    return true;
+}
+
+u64 slot_map_t::resize_slots()
+{
+    u64 bytes_moved = resize_bytes_moved(m_slots, m_capacity) + resize_bytes_moved(m_data_slots, m_capacity);
+    m_slots.resize(m_capacity);
+    m_data_slots.resize(m_capacity, -1);
+    return bytes_moved;
+}
+
+void slot_map_t::enlarge(i32 num)
+{
+    if (m_capacity + num > OGP_INDEX_VALUE_MAX) {
+        ogp_log_warning("Cannot enlarge %s above index_t limit %d", m_type_name, OGP_INDEX_VALUE_MAX);
+        num = OGP_INDEX_VALUE_MAX - m_capacity;
+    }
+
+    if (num <= 0) return;
+
+    m_capacity = m_capacity + num;
+    ogp_log_debug("Enlarging %s by %d, new capacity = %d", m_type_name, num, m_capacity);
+
+    m_stats.grow_events++;
+    m_stats.bytes_moved += resize_data();
+    m_stats.bytes_moved += resize_slots();
+}
+
+void slot_map_t::print_stats(char const *name) const
+{
+    ogp_log_info("    %-12s: %7d / %7d, high water = %7d, grows = %3d, moved = %.1f KiB",
+                 name, m_top_data, m_capacity, m_stats.high_water, m_stats.grow_events, m_stats.bytes_moved / 1024.0);
+}
+
+index_t slot_map_t::acquire_slot()
+{
+    // Create a slot info and increase the data counter
+    index_t user_index {};
+
+    // Slot info will is placed at top position
+    if (m_free_slots_indices.size() > 0) {
+        user_index.value = m_free_slots_indices.back();
+        m_free_slots_indices.pop_back();
+    }
+    else {
+        user_index.value = m_top_slot;
+        m_top_slot++;
+    }
+
+    // Generation of the slot stays, it moved on when the slot was freed
+    slot_t &slot = m_slots[user_index.value];
+    slot.data_index = m_top_data;
+    slot.version = m_version_counter;
+    user_index.version = slot.generation;
+    m_top_data++;
+
+    m_data_slots[slot.data_index] = user_index.value;
+
+    if (m_top_data > m_stats.high_water) {
+        m_stats.high_water = m_top_data;
+    }
+
+    if (m_top_slot > m_capacity) {
+        ogp_log_warning("top_slot >= capacity .......  %d >= %d", m_top_slot, m_capacity);
+        terminate("what? possible?");
+    }
+
+    m_version_counter++;
+
+    return user_index;
+}
+
+index_t slot_map_t::acquire_append_slot(i32 k)
+{
+    index_t user_index = append_index(k);
+
+    slot_t &slot = m_slots[user_index.value];
+    slot.data_index = m_top_data + k;
+    slot.version = m_version_counter + k;
+    m_data_slots[slot.data_index] = user_index.value;
+
+    return user_index;
+}
+
+void slot_map_t::begin_append(i32 num)
+{
+    if (m_appending) {
+        ogp_log_warning("%s is already in append mode", m_type_name);
+        return;
+    }
+
+    // Room is counted from the higher top, data and slots grow together
+    i32 room = m_capacity - std::max(m_top_data, m_top_slot);
+    if (room < num) {
+        enlarge(num - room);
+        room = m_capacity - std::max(m_top_data, m_top_slot);
+    }
+
+    m_append_limit = room;
+    m_append_count.store(0, std::memory_order_relaxed);
+    m_appending = true;
+}
+
+void slot_map_t::end_append()
+{
+    if (!m_appending) return;
+
+    i32 attempted = m_append_count.load(std::memory_order_relaxed);
+    i32 num = std::min(attempted, m_append_limit);
+
+    // Overflow goes after reserved room, dropped only at index_t limit
+    if (attempted > num) {
+        enlarge(std::max(m_top_data, m_top_slot) + attempted - m_capacity);
+        num = std::min(attempted, m_capacity - std::max(m_top_data, m_top_slot));
+        place_append_overflow(num);
+    }
+
+    if (m_top_data + attempted > m_stats.high_water) {
+        m_stats.high_water = m_top_data + attempted;
+    }
+
+    if (attempted > num) {
+        ogp_log_warning("Append to %s dropped %d elements (capacity = %d)", m_type_name, attempted - num, m_capacity);
+    }
+
+    m_top_data += num;
+    m_top_slot += num;
+    m_version_counter += num;
+    m_appending = false;
+}
+
+index_value_t slot_map_t::data_index(index_t index) const
+{
+    if (index.value >= m_top_slot || index.value < 0) {
+        ogp_log_warning("Index out of range (index.value = %d) >= (top_slot = %d), T = %s", index.value, m_top_slot, m_type_name);
+        return -1;
+    }
+
+    slot_t slot = m_slots[index.value];
+
+    if (slot_matches(slot, index)) {
+        return slot.data_index;
+    }
+
+    return -1;
+}
+
+index_value_t slot_map_t::release_slot(index_t index)
+{
+    if (index.value >= m_top_slot || index.value < 0) {
+        ogp_log_warning("Index out of range (index.value = %d) >= (top_slot = %d)", index.value, m_top_slot);
+        return -1;
+    }
+
+    slot_t slot = m_slots[index.value];
+
+    if (!slot_matches(slot, index)) {
+        ogp_log_warning("Cannot destroy, element does not exist (double destroy?)");
+        return -1;
+    }
+
+    // Invalidate slot
+    free_slot(slot);
+
+    index_value_t data_index = slot.data_index;
+    index_value_t last_index = m_top_data - 1;
+
+    // Write back slot info
+    m_slots[index.value] = slot;
+
+    m_free_slots_indices.push_back(index.value);
+
+    // Slot which was pointing to the last element points to 'data_index' now
+    index_value_t moved_slot = m_data_slots[last_index];
+    if (moved_slot != index.value) {
+        m_slots[moved_slot].data_index = data_index;
+        m_data_slots[data_index] = moved_slot;
+    }
+    m_data_slots[last_index] = -1;
+
+    m_top_data--;
+    m_churn++;
+
+    return data_index;
+}
+
+bool slot_map_t::mark_slot(index_t index)
+{
+    if (index.value >= m_top_slot || index.value < 0) {
+        ogp_log_warning("Index out of range (index.value = %d) >= (top_slot = %d)", index.value, m_top_slot);
+        return false;
+    }
+
+    slot_t &slot = m_slots[index.value];
+
+    if (!slot_matches(slot, index)) {
+        ogp_log_warning("Cannot destroy, element does not exist (double destroy?)");
+        return false;
+    }
+
+    free_slot(slot);
+    m_free_slots_indices.push_back(index.value);
+
+    // Dead element is recognized by compaction with no slot pointing to it
+    m_data_slots[slot.data_index] = -1;
+
+    if (m_first_dead == -1 || slot.data_index < m_first_dead) {
+        m_first_dead = slot.data_index;
+    }
+    m_num_dead++;
+    m_churn++;
+
+    return true;
+}
+
+template <typename T>
+static u8 *write_block(u8 *dst, T const *src, i32 num)
+{
+    size_t size = num * sizeof(T);
+    if (size > 0) std::memcpy(dst, src, size);
+    return dst + size;
+}
+
+template <typename T>
+static u8 const *read_block(T *dst, u8 const *src, i32 num)
+{
+    size_t size = num * sizeof(T);
+    if (size > 0) std::memcpy(dst, src, size);
+    return src + size;
+}
+
+u8 *slot_map_t::save_slots(std::vector<u8> &buffer, u32 elem_size) const
+{
+    array_snapshot_header_t header {};
+    header.elem_size = elem_size;
+    header.capacity = m_capacity;
+    header.top_data = m_top_data;
+    header.top_slot = m_top_slot;
+    header.num_free = static_cast<i32>(m_free_slots_indices.size());
+    header.first_dead = m_first_dead;
+    header.num_dead = m_num_dead;
+    header.churn = m_churn;
+    header.version_counter = m_version_counter;
+
+    size_t begin = buffer.size();
+    buffer.resize(begin + sizeof(header)
+                  + header.top_slot * sizeof(slot_t)
+                  + header.top_data * sizeof(index_value_t)
+                  + header.num_free * sizeof(index_value_t)
+                  + header.top_data * elem_size);
+
+    u8 *dst = buffer.data() + begin;
+    dst = write_block(dst, &header, 1);
+    dst = write_block(dst, m_slots.data(), header.top_slot);
+    dst = write_block(dst, m_data_slots.data(), header.top_data);
+    dst = write_block(dst, m_free_slots_indices.data(), header.num_free);
+
+    return dst;
+}
+
+u8 const *slot_map_t::restore_slots(std::vector<u8> const &buffer, size_t &offset, u32 elem_size)
+{
+    array_snapshot_header_t header {};
+    if (offset + sizeof(header) > buffer.size()) {
+        ogp_log_warning("No snapshot of %s at offset %zu", m_type_name, offset);
+        return nullptr;
+    }
+
+    u8 const *src = read_block(&header, buffer.data() + offset, 1);
+
+    size_t size = sizeof(header)
+                  + header.top_slot * sizeof(slot_t)
+                  + header.top_data * sizeof(index_value_t)
+                  + header.num_free * sizeof(index_value_t)
+                  + header.top_data * elem_size;
+
+    if (header.elem_size != elem_size || offset + size > buffer.size()) {
+        ogp_log_warning("Snapshot does not match %s (element size %u, expected %u)", m_type_name, header.elem_size, elem_size);
+        return nullptr;
+    }
+
+    if (header.capacity > m_capacity) {
+        m_capacity = header.capacity;
+        m_stats.bytes_moved += resize_data();
+        m_stats.bytes_moved += resize_slots();
+    }
+
+    // Entries above new top of data range may be left from current state
+    for (index_value_t i = header.top_data; i < m_top_data; ++i) {
+        m_data_slots[i] = -1;
+    }
+
+    m_top_data = header.top_data;
+    m_top_slot = header.top_slot;
+    m_first_dead = header.first_dead;
+    m_num_dead = header.num_dead;
+    m_churn = header.churn;
+    m_version_counter = header.version_counter;
+
+    m_free_slots_indices.resize(header.num_free);
+
+    src = read_block(m_slots.data(), src, header.top_slot);
+    src = read_block(m_data_slots.data(), src, header.top_data);
+    src = read_block(m_free_slots_indices.data(), src, header.num_free);
+
+    if (m_top_data > m_stats.high_water) {
+        m_stats.high_water = m_top_data;
+    }
+
+    offset += size;
+    return src;
+}
+
+bool slot_map_t::exists(index_t index) const
+{
+    if (index.value >= m_top_slot || index.value < 0) {
+        return false;
+    }
+
+    return slot_matches(m_slots[index.value], index);
+}
+
+void slot_map_t::reset()
+{
+    // Unfinished append is dropped, its slots past capacity are made so
+    // their generation moves on like the rest
+    index_value_t top_slot = m_top_slot;
+    if (m_appending) {
+        i32 attempted = m_append_count.load(std::memory_order_relaxed);
+        if (m_top_slot + attempted > m_capacity) enlarge(m_top_slot + attempted - m_capacity);
+        top_slot = std::min(m_top_slot + attempted, m_capacity);
+
+        place_append_overflow(0);
+        m_append_limit = 0;
+        m_append_count.store(0, std::memory_order_relaxed);
+        m_appending = false;
+    }
+
+    // Handles from before reset stop matching
+    for (index_value_t i = 0; i < top_slot; ++i) {
+        if (m_slots[i].version != -1 || i >= m_top_slot) free_slot(m_slots[i]);
+    }
+    std::fill(m_data_slots.begin(), m_data_slots.end(), -1);
+
+    m_top_data = 0;
+    m_top_slot = 0;
+    m_free_slots_indices.clear();
+    m_first_dead = -1;
+    m_num_dead = 0;
+    m_churn = 0;
+}
+
+}  // namespace ogp
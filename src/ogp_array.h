@@ -2,8 +2,16 @@
 #define OGP_ARRAY_H
 
 #include "ogp_defines.h"
+#include "ogp_jobs.h"
 #include "ogp_utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
 #include <vector>
 #include <typeinfo>
 
@@ -13,171 +21,644 @@ namespace ogp
 struct slot_t
 {
     index_value_t data_index {-1};
-    i64 version {-1};
+    i32 generation {0};  // handle version, moves on every time the slot is freed
+    i64 version {-1};    // creation stamp from array version counter, -1 when free
 };
 
-template <typename T, i32 N>
-class array_t
+/// What array_t does when it is full.
+enum class growth_e : i32
 {
-    i32 m_capacity {N};
-    index_value_t m_top_data {0};
-    index_value_t m_top_slot {0};
-    i64 m_version_counter {0};
+    geometric = 0,  // capacity * growth amount
+    fixed_step,     // capacity + growth amount
+    hard_fail,      // error and terminate()
+};
 
-    std::vector<T> data {N};
-    std::vector<slot_t> slots {N};
-    std::vector<index_value_t> m_free_slots_indices {};
+/// Capacity telemetry of one array.
+struct array_stats_t
+{
+    i32 high_water {0};   // max number of elements at once
+    i32 grow_events {0};
+    u64 bytes_moved {0};  // bytes copied by reallocations while growing
+};
+
+/// Bytes copied when 'v' is resized to 'size' elements.
+template <typename T>
+u64 resize_bytes_moved(std::vector<T> const &v, size_t size)
+{
+    return (size > v.capacity()) ? v.size() * sizeof(T) : 0;
+}
+
+/** Header of a binary snapshot of array_t, see array_t::save().
+ *  Followed by blocks: slots [top_slot], data -> slot table [top_data],
+ *  free slots [num_free] and elements [top_data].
+ */
+struct array_snapshot_header_t
+{
+    u32 elem_size {0};
+    i32 capacity {0};
+    index_value_t top_data {0};
+    index_value_t top_slot {0};
+    i32 num_free {0};
+    index_value_t first_dead {-1};
+    i32 num_dead {0};
+    i32 churn {0};
+    i64 version_counter {0};
+};
+
+/// Order of data range after defragmentation.
+enum class defrag_order_e : i32
+{
+    slot = 0,  // order of slots (user indices)
+    creation,  // order of add() calls
+};
+
+/** Data storage of array_t, one contiguous block.
+ *  Fastest iteration, but growing reallocates and copies all elements
+ *  and invalidates every pointer returned by array_t::get().
+ */
+template <typename T>
+class contiguous_storage_t
+{
+    std::vector<T> m_data;
 
 public:
 
     typedef typename std::vector<T>::iterator iterator;
     typedef typename std::vector<T>::const_iterator const_iterator;
 
-    array_t()
+    explicit contiguous_storage_t(i32 capacity)
+        : m_data(capacity)
     {
-        static_assert(N > 0, "Array size should be greater than zero");
-        ogp_log_debug("array_t<%s, %d>, initial capacity = %d", typeid(T).name(), N, m_capacity);
-        data.reserve(N);
-        slots.reserve(N);
-        m_free_slots_indices.reserve(N);
-        m_free_slots_indices.clear();
     }
 
-    array_t(array_t const &) = delete;
-    array_t(array_t &&) = delete;
+    /// Returns number of bytes moved.
+    u64 resize(i32 capacity)
+    {
+        u64 bytes_moved = resize_bytes_moved(m_data, capacity);
+        m_data.resize(capacity);
+        return bytes_moved;
+    }
 
-    index_t add(T const &elem)
+    T &operator[](index_value_t index) { return m_data[index]; }
+
+    T const &operator[](index_value_t index) const { return m_data[index]; }
+
+    /// Raw copy of first 'num' elements, T must be trivially copyable.
+    void copy_to(u8 *dst, i32 num) const
+    {
+        if (num > 0) std::memcpy(dst, m_data.data(), num * sizeof(T));
+    }
+
+    void copy_from(u8 const *src, i32 num)
+    {
+        if (num > 0) std::memcpy(m_data.data(), src, num * sizeof(T));
+    }
+
+    iterator begin() { return std::begin(m_data); }
+
+    const_iterator begin() const { return std::begin(m_data); }
+};
+
+/** Data storage of array_t, fixed size pages which never move.
+ *  Growing allocates new pages only, nothing is copied and pointers
+ *  returned by array_t::get() stay valid across array_t::add().
+ *  Removal still moves the last element into the removed place.
+ */
+template <typename T, i32 PAGE_SIZE = 1024>
+class paged_storage_t
+{
+    static_assert(PAGE_SIZE > 0, "Page size should be greater than zero");
+
+    std::vector<std::unique_ptr<T[]>> m_pages;
+
+    template <typename S, typename V>
+    class iterator_base_t
     {
-        if (m_top_data >= m_capacity * 0.9f) {
-            ogp_log_warning("More than 90%% elements in the array! %s %d / %d", typeid(T).name(), m_top_data, m_capacity);
-            i32 num = static_cast<f32>(m_capacity) * 0.1f;
-            enlarge(num);
+        S *m_storage {nullptr};
+        index_value_t m_index {0};
+
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = V *;
+        using reference = V &;
+
+        iterator_base_t(S *storage, index_value_t index)
+            : m_storage(storage)
+            , m_index(index)
+        {
         }
 
-        if (m_top_data >= m_capacity) {
-            // TODO Add a runtime flag to enable error and terminate() here instead of warning
-            // TODO check if this is possible
-            ogp_log_warning("Max elements exceed in the array! %s %d / %d", typeid(T).name(), m_top_data, m_capacity);
-            return index_t::invalid();
+        V &operator*() const { return (*m_storage)[m_index]; }
+
+        V *operator->() const { return &(*m_storage)[m_index]; }
+
+        iterator_base_t &operator++()
+        {
+            m_index++;
+            return *this;
         }
 
-        // Place new element on top, always on top
-        data[m_top_data] = elem;
+        iterator_base_t operator+(index_value_t num) const
+        {
+            return iterator_base_t(m_storage, m_index + num);
+        }
 
-        // Create a slot info and increase the data counter
-        slot_t slot {};
-        slot.data_index = m_top_data;
-        slot.version = m_version_counter;
-        m_top_data++;
-
-        index_t user_index {};
-        user_index.version = m_version_counter;
-
-        // Slot info will is placed at top position
-        if (m_free_slots_indices.size() > 0) {
-            index_value_t available = m_free_slots_indices.back();
-            m_free_slots_indices.pop_back();
-            slots[available] = slot;
-            user_index.value = available;
+        difference_type operator-(iterator_base_t const &other) const
+        {
+            return m_index - other.m_index;
         }
-        else {
-            user_index.value = m_top_slot;
-            slots[m_top_slot] = slot;
-            m_top_slot++;
+
+        bool operator==(iterator_base_t const &other) const { return m_index == other.m_index; }
+
+        bool operator!=(iterator_base_t const &other) const { return m_index != other.m_index; }
+    };
+
+public:
+
+    typedef iterator_base_t<paged_storage_t, T> iterator;
+    typedef iterator_base_t<paged_storage_t const, T const> const_iterator;
+
+    explicit paged_storage_t(i32 capacity)
+    {
+        resize(capacity);
+    }
+
+    /// Returns number of bytes moved, pages never move.
+    u64 resize(i32 capacity)
+    {
+        size_t num_pages = (capacity + PAGE_SIZE - 1) / PAGE_SIZE;
+        while (m_pages.size() < num_pages) {
+            m_pages.emplace_back(new T[PAGE_SIZE]());
+        }
+        return 0;
+    }
+
+    T &operator[](index_value_t index) { return m_pages[index / PAGE_SIZE][index % PAGE_SIZE]; }
+
+    T const &operator[](index_value_t index) const { return m_pages[index / PAGE_SIZE][index % PAGE_SIZE]; }
+
+    /// Raw copy of first 'num' elements, one block per page.
+    void copy_to(u8 *dst, i32 num) const
+    {
+        for (i32 page = 0; page * PAGE_SIZE < num; ++page) {
+            i32 count = std::min(PAGE_SIZE, num - page * PAGE_SIZE);
+            std::memcpy(dst + page * PAGE_SIZE * sizeof(T), m_pages[page].get(), count * sizeof(T));
         }
+    }
 
-        if (m_top_slot > m_capacity) {
-            ogp_log_warning("top_slot >= capacity .......  %d >= %d", m_top_slot, m_capacity);
-            terminate("what? possible?");
+    void copy_from(u8 const *src, i32 num)
+    {
+        for (i32 page = 0; page * PAGE_SIZE < num; ++page) {
+            i32 count = std::min(PAGE_SIZE, num - page * PAGE_SIZE);
+            std::memcpy(m_pages[page].get(), src + page * PAGE_SIZE * sizeof(T), count * sizeof(T));
         }
+    }
+
+    iterator begin() { return iterator(this, 0); }
 
-        m_version_counter++;
+    const_iterator begin() const { return const_iterator(this, 0); }
+};
 
-        return user_index;
+/** Slot bookkeeping shared by array_t and array_soa_t.
+ *  Users hold index_t handles pointing to slots, slots point to elements
+ *  in a dense data range [0, top_data). The data -> slot table lets
+ *  containers move elements around the dense range in constant time.
+ */
+class slot_map_t
+{
+protected:
+    char const *m_type_name {""};
+    i32 m_capacity {0};
+    index_value_t m_top_data {0};
+    index_value_t m_top_slot {0};
+    i64 m_version_counter {0};
+
+    std::vector<slot_t> m_slots;
+    std::vector<index_value_t> m_data_slots;  // data index -> slot index
+    std::vector<index_value_t> m_free_slots_indices;
+
+    index_value_t m_first_dead {-1};  // lowest data index marked as removed
+    i32 m_num_dead {0};
+
+    growth_e m_growth {growth_e::geometric};
+    f32 m_growth_amount {2.0f};
+    array_stats_t m_stats;
+
+    i32 m_churn {0};  // removals since last defragmentation
+    f32 m_auto_defrag_churn {0.0f};
+    defrag_order_e m_auto_defrag_order {defrag_order_e::slot};
+
+    // Append mode, see begin_append()
+    bool m_appending {false};
+    i32 m_append_limit {0};
+    std::atomic<i32> m_append_count {0};
+
+    slot_map_t(char const *type_name, i32 capacity);
+
+    /// Grow if needed, returns false if there is no place for one more element.
+    bool reserve_one();
+
+    /// Resize slots to m_capacity, returns number of bytes moved.
+    u64 resize_slots();
+
+    /// Bind a slot to the element at top of data range (m_top_data).
+    index_t acquire_slot();
+
+    /** Reserve place for one element in append mode, thread safe.
+     *  Returns its position 'k' counted from top of data range and top of
+     *  slots, positions from m_append_limit on are past reserved room.
+     */
+    i32 reserve_append()
+    {
+        return m_append_count.fetch_add(1, std::memory_order_relaxed);
     }
 
-    // For some container testing
-    T data_at(i32 index) const
+    /// Index the element appended at position 'k' gets, slots past capacity are new.
+    index_t append_index(i32 k) const
     {
-        return data[index];
+        index_t index {};
+        index.value = m_top_slot + k;
+        index.version = (index.value < static_cast<i32>(m_slots.size())) ? m_slots[index.value].generation : 0;
+        return index;
+    }
+
+    /// Free slot, handles to it stop matching.
+    static void free_slot(slot_t &slot)
+    {
+        slot.version = -1;
+        slot.generation = index_t::wrap_version(slot.generation + 1);
+    }
+
+    /** Bind slot m_top_slot + k to element m_top_data + k, creation stamp
+     *  is m_version_counter + k. Threads with distinct 'k' touch distinct
+     *  entries only, tops are moved by end_append().
+     */
+    index_t acquire_append_slot(i32 k);
+
+    /// True if slot is alive and index has its version.
+    static bool slot_matches(slot_t const &slot, index_t index)
+    {
+        return slot.version != -1 && slot.generation == index.version;
     }
 
+    /// Data index of element or -1 if index is invalid.
+    index_value_t data_index(index_t index) const;
+
+    /** Free the slot and bind the slot of last element to the removed place.
+     *  Caller moves its last element (m_top_data after the call) to the
+     *  returned data index. Returns -1 if index is invalid.
+     */
+    index_value_t release_slot(index_t index);
+
+    /** Free the slot but keep its element in data range as dead one.
+     *  Returns false if index is invalid.
+     */
+    bool mark_slot(index_t index);
+
+    /** Squeeze dead elements out of data range in one pass.
+     *  Order of alive elements is kept, move(from, to) moves one element.
+     */
+    template <typename F>
+    void compact_slots(F move)
+    {
+        if (m_num_dead == 0) return;
+
+        index_value_t next = m_first_dead;
+
+        for (index_value_t i = m_first_dead; i < m_top_data; ++i) {
+            index_value_t slot_index = m_data_slots[i];
+            if (slot_index == -1) continue;
+
+            move(i, next);
+            m_data_slots[next] = slot_index;
+            m_slots[slot_index].data_index = next;
+            next++;
+        }
+
+        for (index_value_t i = next; i < m_top_data; ++i) {
+            m_data_slots[i] = -1;
+        }
+
+        m_top_data = next;
+        m_first_dead = -1;
+        m_num_dead = 0;
+    }
+
+    /** Sort data range with less(data_index_a, data_index_b).
+     *  Elements are permuted in place by swap(data_index_a, data_index_b),
+     *  slots follow their elements. Dead elements must be compacted before.
+     */
+    template <typename L, typename F>
+    void sort_slots(L less, F swap)
+    {
+        index_value_t num = m_top_data;
+
+        // order[new data index] = old data index
+        std::vector<index_value_t> order(num);
+        for (index_value_t i = 0; i < num; ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(std::begin(order), std::end(order), less);
+
+        std::vector<index_value_t> data_slots(num);
+        for (index_value_t i = 0; i < num; ++i) {
+            data_slots[i] = m_data_slots[order[i]];
+        }
+
+        // Apply permutation cycle by cycle
+        std::vector<bool> done(num, false);
+        for (index_value_t i = 0; i < num; ++i) {
+            if (done[i]) continue;
+
+            index_value_t j = i;
+            index_value_t k = order[j];
+            while (k != i) {
+                swap(j, k);
+                done[j] = true;
+                j = k;
+                k = order[j];
+            }
+            done[j] = true;
+        }
+
+        for (index_value_t i = 0; i < num; ++i) {
+            m_data_slots[i] = data_slots[i];
+            m_slots[data_slots[i]].data_index = i;
+        }
+
+        m_churn = 0;
+    }
+
+    /// Less function of data indices for given order.
+    auto order_less(defrag_order_e order) const
+    {
+        return [this, order](index_value_t a, index_value_t b) {
+            index_value_t slot_a = m_data_slots[a];
+            index_value_t slot_b = m_data_slots[b];
+            if (order == defrag_order_e::creation) {
+                return m_slots[slot_a].version < m_slots[slot_b].version;
+            }
+            return slot_a < slot_b;
+        };
+    }
+
+    /// True if auto defragmentation is on and enough elements were removed.
+    bool churn_exceeded() const
+    {
+        return m_auto_defrag_churn > 0.0f && m_churn > m_auto_defrag_churn * std::max(m_top_data, index_value_t(1));
+    }
+
+    /** Append header and slot blocks of snapshot to buffer and make room
+     *  for 'elem_size' * size() bytes of elements after them.
+     *  Returns pointer to that room.
+     */
+    u8 *save_slots(std::vector<u8> &buffer, u32 elem_size) const;
+
+    /** Read header and slot blocks at 'offset', grow if snapshot capacity
+     *  is bigger. Returns pointer to element block and moves offset past
+     *  the snapshot, or nullptr if buffer does not hold a snapshot of
+     *  'elem_size' elements.
+     */
+    u8 const *restore_slots(std::vector<u8> const &buffer, size_t &offset, u32 elem_size);
+
+    /// Resize data to m_capacity, returns number of bytes moved.
+    virtual u64 resize_data() = 0;
+
+    /** Move elements appended past reserved room to their positions,
+     *  positions from 'limit' on do not fit and are dropped.
+     */
+    virtual void place_append_overflow(i32 limit) = 0;
+
+public:
+
+    slot_map_t(slot_map_t const &) = delete;
+    slot_map_t(slot_map_t &&) = delete;
+
+    virtual ~slot_map_t() = default;
+
     i32 capacity() const
     {
         return m_capacity;
     }
 
-    void enlarge(i32 num)
+    void enlarge(i32 num);
+
+    /** Growth policy when array is full, amount is the factor for
+     *  growth_e::geometric and number of elements for growth_e::fixed_step.
+     */
+    void set_growth(growth_e growth, f32 amount = 2.0f)
     {
-        m_capacity = m_capacity + num;
-        ogp_log_info("Enlarging %s by %d, new capacity = %d", typeid(T).name(), num, m_capacity);
-        data.resize(m_capacity);
-        slots.resize(m_capacity);
+        m_growth = growth;
+        m_growth_amount = amount;
     }
 
-    T *get(index_t index)
+    array_stats_t const &stats() const
     {
-        return const_cast<T *>(static_cast<array_t<T, N> const *>(this)->get(index));
+        return m_stats;
     }
 
-    /** Get element by its index.
-     * @param index Indicate slot info.
+    void print_stats(char const *name) const;
+
+    /** Defragment automatically after removals of more than
+     *  'churn' * size() elements since the last defragmentation.
+     *  Zero turns it off (default).
      */
-    // TODO use 'exists' method
-    T const *get(index_t index) const
+    void set_auto_defragment(f32 churn, defrag_order_e order = defrag_order_e::slot)
     {
-        if (index.value >= m_top_slot || index.value < 0) {
-            ogp_log_warning("Index out of range (index.value = %d) >= (top_slot = %d), T = %s", index.value, m_top_slot, typeid(T).name());
-            return nullptr;
-        }
+        m_auto_defrag_churn = churn;
+        m_auto_defrag_order = order;
+    }
+
+    /// Removals since the last defragmentation.
+    i32 churn() const
+    {
+        return m_churn;
+    }
+
+    /** Start lock free append mode, array_t::add_concurrent() may then be
+     *  called from many threads at once. Room for 'num' elements is made
+     *  up front, new elements take slots from top only (free list is not
+     *  touched). Nothing else may be called on the array until end_append().
+     */
+    void begin_append(i32 num);
+
+    /** Publish appended elements, size() and iteration include them from now.
+     *  Elements past the room made by begin_append() are placed here, after
+     *  growing the array.
+     */
+    void end_append();
+
+    bool appending() const
+    {
+        return m_appending;
+    }
 
-        slot_t slot = slots[index.value];
+    bool exists(index_t index) const;
 
-        if (slot.version == index.version) {
-            return &data[slot.data_index];
+    i32 size() const
+    {
+        return m_top_data;
+    }
+
+    /// Reset array, an unfinished append is dropped.
+    void reset();
+};
+
+template <typename T, i32 N, typename S = contiguous_storage_t<T>>
+class array_t : public slot_map_t
+{
+    S data {N};
+
+    // Appended past reserved room, with their positions, placed by end_append()
+    std::vector<std::pair<i32, T>> m_append_overflow;
+    std::mutex m_append_mutex;
+
+    u64 resize_data() override
+    {
+        return data.resize(m_capacity);
+    }
+
+    void place_append_overflow(i32 limit) override
+    {
+        for (std::pair<i32, T> const &overflow : m_append_overflow) {
+            if (overflow.first >= limit) continue;
+            data[m_top_data + overflow.first] = overflow.second;
+            acquire_append_slot(overflow.first);
         }
+        m_append_overflow.clear();
+    }
+
+    auto data_mover()
+    {
+        return [this](index_value_t from, index_value_t to) {
+            this->data[to] = std::move(this->data[from]);
+        };
+    }
+
+    auto data_swapper()
+    {
+        return [this](index_value_t a, index_value_t b) {
+            std::swap(this->data[a], this->data[b]);
+        };
+    }
+
+public:
+
+    typedef typename S::iterator iterator;
+    typedef typename S::const_iterator const_iterator;
 
-        return nullptr;
+    array_t()
+        : slot_map_t(typeid(T).name(), N)
+    {
+        static_assert(N > 0, "Array size should be greater than zero");
+        static_assert(N <= OGP_INDEX_VALUE_MAX, "Array size does not fit in index_t");
+        ogp_log_debug("array_t<%s, %d>, initial capacity = %d", typeid(T).name(), N, m_capacity);
     }
 
-    bool exists(index_t index) const
+    index_t add(T const &elem)
     {
-        if (index.value >= m_top_slot || index.value < 0) {
-            return false;
+        if (!reserve_one()) {
+            return index_t::invalid();
         }
 
-        slot_t slot = slots[index.value];
+        // Place new element on top, always on top
+        data[m_top_data] = elem;
+
+        return acquire_slot();
+    }
+
+    /** Same as add() but thread safe in append mode (see begin_append()).
+     *  Past reserved room elements wait under a lock until end_append(),
+     *  their index is valid from then on. Outside append mode it is plain add().
+     */
+    index_t add_concurrent(T const &elem)
+    {
+        if (!m_appending) {
+            return add(elem);
+        }
 
-        if (slot.version == index.version) {
-            return true;
+        i32 k = reserve_append();
+        if (k >= m_append_limit) {
+            std::lock_guard<std::mutex> lock(m_append_mutex);
+            m_append_overflow.emplace_back(k, elem);
+            return append_index(k);
         }
 
-        return false;
+        data[m_top_data + k] = elem;
+
+        return acquire_append_slot(k);
+    }
+
+    // For some container testing
+    T data_at(i32 index) const
+    {
+        return data[index];
+    }
+
+    T *get(index_t index)
+    {
+        return const_cast<T *>(static_cast<array_t const *>(this)->get(index));
+    }
+
+    /** Get element by its index.
+     * @param index Indicate slot info.
+     */
+    T const *get(index_t index) const
+    {
+        index_value_t i = data_index(index);
+        return (i == -1) ? nullptr : &data[i];
     }
 
     array_t::iterator begin()
     {
-        return std::begin(data);
+        return data.begin();
     }
 
     array_t::iterator end()
     {
-        return std::begin(data) + m_top_data;
+        return data.begin() + m_top_data;
     }
 
     array_t::const_iterator begin() const
     {
-        return std::begin(data);
+        return data.begin();
     }
 
     array_t::const_iterator end() const
     {
-        return std::begin(data) + m_top_data;
+        return data.begin() + m_top_data;
+    }
+
+    /** Split data range into chunks of 'grain' elements and call
+     *  fn(first, last) for each chunk on worker threads (see jobs_t).
+     *  Chunks must not add or remove elements. Offset of a chunk in data
+     *  range is 'first - begin()'.
+     */
+    template <typename F>
+    void parallel_for_chunks(F fn, i32 grain = 1024)
+    {
+        iterator first = begin();
+        jobs().parallel_for(0, m_top_data, grain, [&fn, &first](i32 chunk_begin, i32 chunk_end) {
+            fn(first + chunk_begin, first + chunk_end);
+        });
+    }
+
+    template <typename F>
+    void parallel_for_chunks(F fn, i32 grain = 1024) const
+    {
+        const_iterator first = begin();
+        jobs().parallel_for(0, m_top_data, grain, [&fn, &first](i32 chunk_begin, i32 chunk_end) {
+            fn(first + chunk_begin, first + chunk_end);
+        });
     }
 
     /** Remove element by its index.
      *  It replace pointed element with last element in data array.
-     *  Slot info in slots array is fixed then.
+     *  Slot info of the moved element is found through data -> slot table,
+     *  so removal does not depend on the number of elements.
      *  It works for one element array becase that element is switched with himself.
      *  \param index Indicate slot info.
      *
@@ -185,45 +666,92 @@ public:
      */
     void remove_index(index_t index)
     {
-        if (index.value >= m_top_slot || index.value < 0) {
-            ogp_log_warning("Index out of range (index.value = %d) >= (top_slot = %d)", index.value, m_top_slot);
-            return;
-        }
+        compact();
 
-        slot_t slot = slots[index.value];
+        index_value_t i = release_slot(index);
+        if (i == -1) return;
 
-        if (slot.version != index.version) {
-            ogp_log_warning("Cannot destroy, element does not exist (double destroy?)");
-            return;
-        }
+        // Swap last element with removed one
+        std::swap(this->data[i], this->data[m_top_data]);
 
-        // Invalidate slot
-        slot.version = -1;
+        if (churn_exceeded()) defragment(m_auto_defrag_order);
+    }
 
-        index_value_t data_index = slot.data_index;
+    /** Deferred removal, index is invalid right away but its element stays
+     *  in data range (and in iteration) until compact() is called.
+     *  Marking does not move anything, so it is safe inside a range-for.
+     */
+    void mark_removed(index_t index)
+    {
+        mark_slot(index);
+    }
 
-        // Write back slot info
-        slots[index.value] = slot;
+    /// Remove all marked elements in one pass over data range.
+    void compact()
+    {
+        if (m_num_dead == 0) return;
 
-        m_free_slots_indices.push_back(index.value);
+        compact_slots(data_mover());
 
-        // Swap last element with removed one
-        std::swap(this->data[data_index], this->data[m_top_data - 1]);
+        if (churn_exceeded()) defragment(m_auto_defrag_order);
+    }
+
+    /// Batch removal, mark all then compact once.
+    template <typename C>
+    void remove_indices(C const &indices)
+    {
+        for (index_t const &index : indices) {
+            mark_slot(index);
+        }
+        compact();
+    }
 
-        // Find who is pointing with 'data_index' 'to 'top_data - 1' (last)
-        // and change its pointer/index to 'removed slot.data_index'
+    /** Put data range back in slot or creation order, so iteration over
+     *  user indices walks memory forward again after many removals.
+     */
+    void defragment(defrag_order_e order = defrag_order_e::slot)
+    {
+        compact_slots(data_mover());
+        sort_slots(order_less(order), data_swapper());
+    }
 
-        for (i32 i = 0; i < m_top_slot; ++i) {
-            // TODO Checking slots from 0 to top_slot but it will be faster
-            // to check in reverse order because last element was moved
+    /// Put data range in order of key(element).
+    template <typename K>
+    void defragment_by(K key)
+    {
+        compact_slots(data_mover());
+        sort_slots([this, &key](index_value_t a, index_value_t b) {
+            return key(this->data[a]) < key(this->data[b]);
+        }, data_swapper());
+    }
 
-            if (slots[i].version != -1 && slots[i].data_index == m_top_data - 1) {
-                slots[i].data_index = data_index;
-                break;
-            }
-        }
+    /** Append binary snapshot of the whole array to buffer: elements,
+     *  slots, free list and version counter as a few contiguous blocks.
+     *  Buffer can be written to a file as it is. Returns bytes written.
+     */
+    size_t save(std::vector<u8> &buffer) const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshot needs trivially copyable T");
+
+        size_t begin = buffer.size();
+        u8 *dst = save_slots(buffer, sizeof(T));
+        data.copy_to(dst, m_top_data);
+        return buffer.size() - begin;
+    }
+
+    /** Restore snapshot made by save() at 'offset' of buffer, offset is
+     *  moved past it. Indices valid at save time are valid again.
+     *  Returns false and leaves array untouched if there is no snapshot.
+     */
+    bool restore(std::vector<u8> const &buffer, size_t &offset)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshot needs trivially copyable T");
+
+        u8 const *src = restore_slots(buffer, offset, sizeof(T));
+        if (src == nullptr) return false;
 
-        m_top_data--;
+        data.copy_from(src, m_top_data);
+        return true;
     }
 
     // Rremove element by value (all occurences).
@@ -231,7 +759,7 @@ public:
     {
         i32 count = 0;
         for (i32 i = 0; i < m_top_slot;) {
-            slot_t slot = slots[i];
+            slot_t slot = m_slots[i];
 
             if (slot.version == -1) {
                 i = i + 1;
@@ -241,7 +769,7 @@ public:
             if (this->data[slot.data_index] == elem) {
                 index_t elem_index {};
                 elem_index.value = i;
-                elem_index.version = slot.version;
+                elem_index.version = slot.generation;
                 remove_index(elem_index);
                 count++;
                 continue;
@@ -252,18 +780,6 @@ public:
 
         return count;
     }
-
-    i32 size() const
-    {
-        return m_top_data;
-    }
-
-    /// Reset array
-    void reset()
-    {
-        this->m_top_data = 0;
-        this->m_top_slot = 0;
-    }
 };
 
 }  // namespace ogp
@@ -0,0 +1,239 @@
+#ifndef OGP_ARRAY_SOA_H
+#define OGP_ARRAY_SOA_H
+
+#include "ogp_array.h"
+#include "ogp_defines.h"
+#include "ogp_utils.h"
+
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ogp
+{
+
+/** Structure of arrays sibling of array_t.
+ *  Same index_t handles, but every field lives in its own contiguous column,
+ *  so a pass which needs only some fields streams only those columns.
+ *  Columns are addressed by field position in 'Fields'.
+ */
+template <i32 N, typename... Fields>
+class array_soa_t : public slot_map_t
+{
+    std::tuple<std::vector<Fields>...> m_columns;
+
+    template <size_t... I>
+    u64 resize_columns(std::index_sequence<I...>)
+    {
+        u64 bytes_moved = (resize_bytes_moved(std::get<I>(m_columns), m_capacity) + ...);
+        (std::get<I>(m_columns).resize(m_capacity), ...);
+        return bytes_moved;
+    }
+
+    template <size_t... I>
+    void set_row(index_value_t row, std::tuple<Fields const &...> values, std::index_sequence<I...>)
+    {
+        ((std::get<I>(m_columns)[row] = std::get<I>(values)), ...);
+    }
+
+    template <size_t... I>
+    void move_row(index_value_t from, index_value_t to, std::index_sequence<I...>)
+    {
+        ((std::get<I>(m_columns)[to] = std::move(std::get<I>(m_columns)[from])), ...);
+    }
+
+    template <size_t... I>
+    void swap_rows(index_value_t a, index_value_t b, std::index_sequence<I...>)
+    {
+        (std::swap(std::get<I>(m_columns)[a], std::get<I>(m_columns)[b]), ...);
+    }
+
+    auto row_mover()
+    {
+        return [this](index_value_t from, index_value_t to) {
+            move_row(from, to, std::index_sequence_for<Fields...> {});
+        };
+    }
+
+    template <typename F, typename... C>
+    void for_each_row(F &fn, C *... columns) const
+    {
+        for (index_value_t row = 0; row < m_top_data; ++row) {
+            fn(columns[row]...);
+        }
+    }
+
+    u64 resize_data() override
+    {
+        return resize_columns(std::index_sequence_for<Fields...> {});
+    }
+
+    // No concurrent add, nothing waits past reserved room
+    void place_append_overflow(i32) override {}
+
+    /// Columns one after another, [0, size()) of each.
+    template <size_t... I>
+    void copy_columns_to(u8 *dst, std::index_sequence<I...>) const
+    {
+        ((std::memcpy(dst, std::get<I>(m_columns).data(), m_top_data * sizeof(Fields)), dst += m_top_data * sizeof(Fields)), ...);
+    }
+
+    template <size_t... I>
+    void copy_columns_from(u8 const *src, std::index_sequence<I...>)
+    {
+        ((std::memcpy(std::get<I>(m_columns).data(), src, m_top_data * sizeof(Fields)), src += m_top_data * sizeof(Fields)), ...);
+    }
+
+public:
+
+    static constexpr size_t NUM_FIELDS = sizeof...(Fields);
+    static constexpr u32 ROW_SIZE = (sizeof(Fields) + ...);
+
+    template <size_t I>
+    using field_t = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+    array_soa_t()
+        : slot_map_t(typeid(std::tuple<Fields...>).name(), N)
+    {
+        static_assert(N > 0, "Array size should be greater than zero");
+        static_assert(N <= OGP_INDEX_VALUE_MAX, "Array size does not fit in index_t");
+        static_assert(NUM_FIELDS > 0, "Array should have at least one field");
+        resize_data();
+    }
+
+    index_t add(Fields const &... values)
+    {
+        if (!reserve_one()) {
+            return index_t::invalid();
+        }
+
+        // Place new row on top, always on top
+        set_row(m_top_data, std::tuple<Fields const &...>(values...), std::index_sequence_for<Fields...> {});
+
+        return acquire_slot();
+    }
+
+    /// Field 'I' of element or nullptr if index is invalid.
+    template <size_t I>
+    field_t<I> *get(index_t index)
+    {
+        index_value_t i = data_index(index);
+        return (i == -1) ? nullptr : &std::get<I>(m_columns)[i];
+    }
+
+    template <size_t I>
+    field_t<I> const *get(index_t index) const
+    {
+        index_value_t i = data_index(index);
+        return (i == -1) ? nullptr : &std::get<I>(m_columns)[i];
+    }
+
+    /// Dense column of field 'I', valid range is [0, size()).
+    template <size_t I>
+    field_t<I> *column()
+    {
+        return std::get<I>(m_columns).data();
+    }
+
+    template <size_t I>
+    field_t<I> const *column() const
+    {
+        return std::get<I>(m_columns).data();
+    }
+
+    /** Call fn with references to fields 'I...' of every element.
+     *  Only chosen columns are touched.
+     */
+    template <size_t... I, typename F>
+    void for_each(F fn)
+    {
+        for_each_row(fn, column<I>()...);
+    }
+
+    template <size_t... I, typename F>
+    void for_each(F fn) const
+    {
+        for_each_row(fn, column<I>()...);
+    }
+
+    /// Remove element by its index, last row is moved to the removed place.
+    void remove_index(index_t index)
+    {
+        compact();
+
+        index_value_t i = release_slot(index);
+        if (i == -1) return;
+
+        if (i != m_top_data) {
+            move_row(m_top_data, i, std::index_sequence_for<Fields...> {});
+        }
+
+        if (churn_exceeded()) defragment(m_auto_defrag_order);
+    }
+
+    /// Deferred removal, see array_t::mark_removed().
+    void mark_removed(index_t index)
+    {
+        mark_slot(index);
+    }
+
+    /// Remove all marked rows in one pass over data range.
+    void compact()
+    {
+        if (m_num_dead == 0) return;
+
+        compact_slots(row_mover());
+
+        if (churn_exceeded()) defragment(m_auto_defrag_order);
+    }
+
+    /// Put rows back in slot or creation order, see array_t::defragment().
+    void defragment(defrag_order_e order = defrag_order_e::slot)
+    {
+        compact_slots(row_mover());
+        sort_slots(order_less(order), [this](index_value_t a, index_value_t b) {
+            swap_rows(a, b, std::index_sequence_for<Fields...> {});
+        });
+    }
+
+    /// Batch removal, mark all then compact once.
+    template <typename C>
+    void remove_indices(C const &indices)
+    {
+        for (index_t const &index : indices) {
+            mark_slot(index);
+        }
+        compact();
+    }
+
+    /** Append binary snapshot to buffer, see array_t::save(). Elements are
+     *  stored column after column. Returns bytes written.
+     */
+    size_t save(std::vector<u8> &buffer) const
+    {
+        static_assert((std::is_trivially_copyable<Fields>::value && ...), "Snapshot needs trivially copyable fields");
+
+        size_t begin = buffer.size();
+        u8 *dst = save_slots(buffer, ROW_SIZE);
+        copy_columns_to(dst, std::index_sequence_for<Fields...> {});
+        return buffer.size() - begin;
+    }
+
+    /// Restore snapshot made by save(), see array_t::restore().
+    bool restore(std::vector<u8> const &buffer, size_t &offset)
+    {
+        static_assert((std::is_trivially_copyable<Fields>::value && ...), "Snapshot needs trivially copyable fields");
+
+        u8 const *src = restore_slots(buffer, offset, ROW_SIZE);
+        if (src == nullptr) return false;
+
+        copy_columns_from(src, std::index_sequence_for<Fields...> {});
+        return true;
+    }
+};
+
+}  // namespace ogp
+
+#endif  // OGP_ARRAY_SOA_H
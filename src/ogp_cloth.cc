@@ -182,7 +182,7 @@ void cloth_t::update_faces(physics_t *physics, f32 frame_dt)
     }
 }
 
-void cloth_t::draw(render_context_t *rc)
+void cloth_t::draw(render_recorder_t *rc)
 {
     color_t color = rc->set_fill_color(80, 101, 166);
     for (cloth_face_t const &cf : m_faces) {
@@ -9,7 +9,7 @@
 namespace ogp
 {
 
-class render_context_t;
+class render_recorder_t;
 
 struct cloth_face_t
 {
@@ -44,7 +44,7 @@ public:
 
     void update_faces(physics_t *physics, f32 frame_dt);
 
-    void draw(render_context_t *rc);
+    void draw(render_recorder_t *rc);
 
     vec3 get_seventh_pos(physics_t *physics, f32 frame_dt);
 };
@@ -41,11 +41,30 @@ constexpr f32 OGP_PERSPECTIVE_FAR  = 100.0f;
 
 // PHYSICS .....................................................................
 
+// OGP_DETERMINISTIC builds never fuse a * b + c into FMA (-ffp-contract=off),
+// so scalar and SIMD kernels round the same way and steps give same bits on
+// every machine.
+#if defined(OGP_DETERMINISTIC) && defined(__FAST_MATH__)
+#error "OGP_DETERMINISTIC needs IEEE floating point, build without -ffast-math"
+#endif
+
 constexpr i32 OGP_PHYSICS_NUM_PARTICLES      = 1024;
 constexpr i32 OGP_PHYSICS_NUM_BODIES         = 128;
 constexpr i32 OGP_PHYSICS_NUM_CONSTRAINTS    = 1024;
 constexpr i32 OGP_PHYSICS_NUM_PINS           = 128;
+constexpr i32 OGP_PHYSICS_NUM_SPRINGS        = 1024;
 constexpr i32 OGP_PHYSICS_NUM_USER_BODIES    = 128;
+constexpr i32 OGP_PHYSICS_NUM_COLLIDERS      = 64;
+constexpr i32 OGP_PHYSICS_NUM_MESHES         = 16;
+constexpr i32 OGP_PHYSICS_GRAIN              = 1024;  // particles per parallel chunk
+constexpr f32 OGP_PHYSICS_SLEEP_ENERGY       = 5e-5f; // kinetic energy per mass, 1 cm/s
+constexpr i32 OGP_PHYSICS_SLEEP_STEPS        = 60;    // still steps before island sleeps
+constexpr i32 OGP_PHYSICS_NUM_SNAPSHOTS      = 64;    // frames kept for rollback
+constexpr f32 OGP_PHYSICS_DEFRAG_CHURN       = 0.5f;  // removed share of rows before step defragments
+
+// RENDER ......................................................................
+
+constexpr i32 OGP_RENDER_GRAIN = 512;  // render requests per parallel chunk
 
 // MODELS ......................................................................
 
@@ -69,12 +88,31 @@ constexpr std::array<u32, 36> OGP_CUBE_INDICES = {
     2, 3, 0, 0, 3, 1,  // bottom
 };
 
-using index_value_t = i64;
+// HANDLES .....................................................................
+
+// index_t packs slot index and version into 32 bits, split is chosen here.
+// More value bits allow bigger arrays. Version is a generation of its slot,
+// which moves on when the slot is freed, so a stale handle matches again only
+// after its own slot is reused OGP_INDEX_VERSION_MAX + 1 times.
+constexpr i32 OGP_INDEX_VALUE_BITS   = 22;
+constexpr i32 OGP_INDEX_VERSION_BITS = 32 - OGP_INDEX_VALUE_BITS;
+constexpr i32 OGP_INDEX_VALUE_MAX    = (1 << (OGP_INDEX_VALUE_BITS - 1)) - 1;
+constexpr i32 OGP_INDEX_VERSION_MAX  = (1 << (OGP_INDEX_VERSION_BITS - 1)) - 1;
+
+static_assert(OGP_INDEX_VALUE_BITS > 1 && OGP_INDEX_VERSION_BITS > 1, "Both index_t fields need at least two bits");
+
+using index_value_t = i32;
 
 struct index_t
 {
-    index_value_t value {-1};
-    i64 version {-1};
+    index_value_t value : OGP_INDEX_VALUE_BITS;
+    i32 version : OGP_INDEX_VERSION_BITS;
+
+    index_t()
+        : value(-1)
+        , version(-1)
+    {
+    }
 
     static index_t invalid()
     {
@@ -84,6 +122,12 @@ struct index_t
         return invalid;
     }
 
+    /// Handle version of a (non-negative) version counter.
+    static i32 wrap_version(i64 counter)
+    {
+        return static_cast<i32>(counter % (OGP_INDEX_VERSION_MAX + 1));
+    }
+
     bool operator== (index_t const &other) const
     {
         return (other.value == value) && (other.version == version);
@@ -98,6 +142,8 @@ struct index_t
     };
 };
 
+static_assert(sizeof(index_t) == 4, "index_t should fit in 32 bits");
+
 template <typename T>
 struct index_holder_t
 {
@@ -0,0 +1,119 @@
+#include "ogp_jobs.h"
+
+#include "ogp_utils.h"
+
+#include <algorithm>
+
+namespace ogp
+{
+
+static thread_local bool t_inside_task = false;
+
+jobs_t::jobs_t(i32 num_workers)
+{
+    m_active_workers = num_workers;
+    for (i32 i = 0; i < num_workers; ++i) {
+        m_workers.emplace_back(&jobs_t::worker_loop, this, i);
+    }
+    ogp_log_debug("jobs_t: %d workers", num_workers);
+}
+
+jobs_t::~jobs_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread &worker : m_workers) {
+        worker.join();
+    }
+}
+
+bool jobs_t::is_serial() const
+{
+    return m_serial || m_active_workers == 0 || t_inside_task;
+}
+
+void jobs_t::set_num_threads(i32 num)
+{
+    // Never in the middle of a batch
+    std::lock_guard<std::mutex> run_lock(m_run_mutex);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_active_workers = std::min(std::max(num, 1), max_threads()) - 1;
+}
+
+void jobs_t::run_tasks()
+{
+    t_inside_task = true;
+    for (;;) {
+        i32 i = m_next_task.fetch_add(1);
+        if (i >= m_num_tasks) break;
+        (*m_task)(i);
+    }
+    t_inside_task = false;
+}
+
+void jobs_t::worker_loop(i32 worker)
+{
+    u64 seen_batch = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this, seen_batch] { return m_quit || m_batch != seen_batch; });
+            if (m_quit) return;
+            seen_batch = m_batch;
+
+            // Inactive workers skip the batch and are not waited for
+            if (worker >= m_batch_workers) continue;
+        }
+
+        run_tasks();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy_workers--;
+        }
+        m_done.notify_one();
+    }
+}
+
+void jobs_t::run(i32 num_tasks, std::function<void(i32)> const &task)
+{
+    if (is_serial()) {
+        for (i32 i = 0; i < num_tasks; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(m_run_mutex);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_num_tasks = num_tasks;
+        m_next_task = 0;
+        m_batch_workers = m_active_workers;
+        m_busy_workers = m_batch_workers;
+        m_batch++;
+    }
+    m_wake.notify_all();
+
+    // Calling thread helps
+    run_tasks();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy_workers == 0; });
+    m_task = nullptr;
+}
+
+jobs_t &jobs()
+{
+    static jobs_t pool {std::max(0, static_cast<i32>(std::thread::hardware_concurrency()) - 1)};
+    return pool;
+}
+
+}  // namespace ogp
@@ -0,0 +1,125 @@
+#ifndef OGP_JOBS_H
+#define OGP_JOBS_H
+
+#include "ogp_defines.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ogp
+{
+
+/** Pool of worker threads running one batch of tasks at a time.
+ *  Calling thread works on the batch too and returns when it is done.
+ *  Without workers, in serial mode or when called from inside a task,
+ *  tasks run in order on calling thread, same as a plain loop.
+ */
+class jobs_t
+{
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_run_mutex;  // one batch at a time
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    std::function<void(i32)> const *m_task {nullptr};
+    i32 m_num_tasks {0};
+    std::atomic<i32> m_next_task {0};
+    i32 m_busy_workers {0};
+    std::atomic<i32> m_active_workers {0};  // workers taking part in next batches, the rest sleep
+    i32 m_batch_workers {0};                // workers taking part in current batch
+    u64 m_batch {0};
+    bool m_quit {false};
+    std::atomic<bool> m_serial {false};     // is_serial() reads both without lock
+
+    void worker_loop(i32 worker);
+
+    void run_tasks();
+
+public:
+
+    explicit jobs_t(i32 num_workers);
+
+    ~jobs_t();
+
+    jobs_t(jobs_t const &) = delete;
+
+    /// Active workers plus calling thread.
+    i32 num_threads() const
+    {
+        return m_active_workers + 1;
+    }
+
+    /// All workers plus calling thread.
+    i32 max_threads() const
+    {
+        return static_cast<i32>(m_workers.size()) + 1;
+    }
+
+    /** Run following batches on 'num' threads, calling thread included,
+     *  clamped to [1, max_threads()]. Work is split the same way for any
+     *  number, only who runs it changes.
+     */
+    void set_num_threads(i32 num);
+
+    /// Serial mode runs everything on calling thread, for debugging and replays.
+    void set_serial(bool serial)
+    {
+        m_serial = serial;
+    }
+
+    bool is_serial() const;
+
+    /// Run task(i) for every i in [0, num_tasks), order is not specified.
+    void run(i32 num_tasks, std::function<void(i32)> const &task);
+
+    /** Split [begin, end) into chunks of 'grain' elements, call fn(chunk_begin, chunk_end)
+     *  for each. Chunks are the same no matter how many threads run them.
+     */
+    template <typename F>
+    void parallel_for(i32 begin, i32 end, i32 grain, F fn)
+    {
+        if (grain < 1) grain = 1;
+        i32 num = end - begin;
+        if (num <= 0) return;
+
+        i32 num_chunks = (num + grain - 1) / grain;
+
+        struct chunks_t
+        {
+            i32 begin;
+            i32 end;
+            i32 grain;
+            F *fn;
+        } chunks {begin, end, grain, &fn};
+
+        // Captures one pointer only, std::function keeps it without allocation
+        auto task = [&chunks](i32 chunk) {
+            i32 chunk_begin = chunks.begin + chunk * chunks.grain;
+            i32 chunk_end = std::min(chunk_begin + chunks.grain, chunks.end);
+            (*chunks.fn)(chunk_begin, chunk_end);
+        };
+
+        if (num_chunks == 1 || is_serial()) {
+            for (i32 chunk = 0; chunk < num_chunks; ++chunk) {
+                task(chunk);
+            }
+            return;
+        }
+
+        run(num_chunks, task);
+    }
+};
+
+/// Shared pool, one worker less than hardware threads.
+jobs_t &jobs();
+
+}  // namespace ogp
+
+#endif  // OGP_JOBS_H
@@ -1,6 +1,7 @@
 #include "ogp_mesh.h"
 
 #include "ogp_array.h"
+#include "ogp_physics.h"
 #include "ogp_utils.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION // define this in only *one* .cc
@@ -107,7 +108,7 @@ mesh_t create_cube(f32 edge)
     return mesh;
 }
 
-mesh_t load_mesh(char const *filename)
+std::vector<vec3> load_mesh_triangles(char const *filename)
 {
     ogp_log_info("Loading mesh from: %s", filename);
 
@@ -126,7 +127,7 @@ mesh_t load_mesh(char const *filename)
         terminate("error loading mesh");
     }
 
-    color_mesh_t cmesh {};
+    std::vector<vec3> triangles;
 
     // Loop over shapes
     for (size_t s = 0; s < shapes.size(); s++) {
@@ -144,7 +145,6 @@ mesh_t load_mesh(char const *filename)
                 // access to vertex
                 tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
-                // ogp_log_me("vertex");
                 f32 vx = attrib.vertices[3 * idx.vertex_index + 0];
                 f32 vy = attrib.vertices[3 * idx.vertex_index + 1];
                 f32 vz = attrib.vertices[3 * idx.vertex_index + 2];
@@ -153,21 +153,10 @@ mesh_t load_mesh(char const *filename)
                 // float nz = attrib.normals[3 * idx.normal_index + 2];
                 // float tx = attrib.texcoords[2 * idx.texcoord_index + 0];
                 // float ty = attrib.texcoords[2 * idx.texcoord_index + 1];
-                // ogp_log_me("vertex end");
 
-                vertex_PNC_t vertex {};
-                vertex.position = vec3 {vx, vy, vz};
-                vertex.color = OGP_COLOR_WHITE;
-
-                cmesh.vertices.push_back(vertex);
+                triangles.push_back(vec3 {vx, vy, vz});
             }
 
-            face_t face = face_t {};
-            face.v0 = index_offset + 0;
-            face.v1 = index_offset + 1;
-            face.v2 = index_offset + 2;
-            cmesh.faces.push_back(face);
-
             index_offset += fv;
 
             // per-face material
@@ -191,6 +180,30 @@ mesh_t load_mesh(char const *filename)
 
     }
 
+    return triangles;
+}
+
+mesh_t load_mesh(char const *filename)
+{
+    std::vector<vec3> triangles = load_mesh_triangles(filename);
+
+    color_mesh_t cmesh {};
+
+    for (size_t v = 0; v < triangles.size(); v += 3) {
+        for (size_t k = 0; k < 3; ++k) {
+            vertex_PNC_t vertex {};
+            vertex.position = triangles[v + k];
+            vertex.color = OGP_COLOR_WHITE;
+            cmesh.vertices.push_back(vertex);
+        }
+
+        face_t face = face_t {};
+        face.v0 = v + 0;
+        face.v1 = v + 1;
+        face.v2 = v + 2;
+        cmesh.faces.push_back(face);
+    }
+
     cmesh.gl_buffer.init();
     cmesh.recalculate_normals();
     cmesh.update_vbo();
@@ -200,4 +213,32 @@ mesh_t load_mesh(char const *filename)
     return mesh;
 }
 
+std::vector<vec3> get_mesh_triangles(mesh_t mesh)
+{
+    std::vector<vec3> triangles;
+
+    color_mesh_t const *cmesh = get_color_mesh(mesh);
+    NULL_WARNING(cmesh);
+    if (cmesh == nullptr) return triangles;
+
+    triangles.reserve(3 * cmesh->faces.size());
+    for (face_t const &face : cmesh->faces) {
+        triangles.push_back(cmesh->vertices[face.v0].position);
+        triangles.push_back(cmesh->vertices[face.v1].position);
+        triangles.push_back(cmesh->vertices[face.v2].position);
+    }
+
+    return triangles;
+}
+
+collider_t create_mesh_collider(mesh_t mesh, vec3 translation, quat rotation, f32 scale, physics_t *physics)
+{
+    std::vector<vec3> triangles = get_mesh_triangles(mesh);
+    for (vec3 &v : triangles) {
+        v = translation + rotation * (v * scale);
+    }
+
+    return physics->create_triangle_mesh(triangles);
+}
+
 }  // namespace ogp
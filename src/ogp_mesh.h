@@ -9,6 +9,9 @@
 namespace ogp
 {
 
+class physics_t;
+struct collider_t;
+
 struct mesh_t : public index_holder_t<mesh_t> { };
 
 struct face_t
@@ -67,6 +70,17 @@ mesh_t create_cube(f32 edge = 1.0f);
 
 mesh_t load_mesh(char const *filename);
 
+/// Triangles of obj file, 3 positions per triangle, no GL calls.
+std::vector<vec3> load_mesh_triangles(char const *filename);
+
+/// Triangles of mesh, 3 positions per triangle.
+std::vector<vec3> get_mesh_triangles(mesh_t mesh);
+
+/** Static collider from mesh placed in world, vertices are scaled,
+ *  rotated and then translated.
+ */
+collider_t create_mesh_collider(mesh_t mesh, vec3 translation, quat rotation, f32 scale, physics_t *physics);
+
 }  // namespace ogp
 
 #endif  // OGP_MESH_H
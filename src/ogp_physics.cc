@@ -1,124 +1,795 @@
 #include "ogp_physics.h"
 
+#include "ogp_jobs.h"
+#include "ogp_physics_kernels.h"
 #include "ogp_render.h"
 #include "ogp_utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <numeric>
+#include <type_traits>
 
 namespace ogp
 {
 
+physics_t::physics_t()
+{
+    m_snapshots.resize(OGP_PHYSICS_NUM_SNAPSHOTS);
+}
+
+template <size_t I>
+static void copy_particle_field(p_particles_t &p_particles, index_t from, index_t to)
+{
+    *p_particles.get<I>(to) = *p_particles.get<I>(from);
+}
+
 void physics_t::satisfy_pins()
 {
     for (p_pin_t const &p_pin : m_db.p_pins) {
-        p_particle_t *m = m_db.p_particles.get(p_pin.master.particle.index);
-        p_particle_t *s = m_db.p_particles.get(p_pin.slave.particle.index);
+        index_t m = p_pin.master.particle.index;
+        index_t s = p_pin.slave.particle.index;
 
-        s->position.prev = m->position.prev;
-        s->position.now = m->position.now;
-        s->position.next = m->position.next;
+        copy_particle_field<pp_position_prev>(m_db.p_particles, m, s);
+        copy_particle_field<pp_position_now>(m_db.p_particles, m, s);
+        copy_particle_field<pp_position_next>(m_db.p_particles, m, s);
 
-        s->velocity.prev = m->velocity.prev;
-        s->velocity.now = m->velocity.now;
-        s->velocity.next = m->velocity.next;
-
-        s->acceleration.prev = m->acceleration.prev;
-        s->acceleration.now = m->acceleration.now;
-        s->acceleration.next = m->acceleration.next;
+        copy_particle_field<pp_velocity_now>(m_db.p_particles, m, s);
+        copy_particle_field<pp_velocity_next>(m_db.p_particles, m, s);
     }
 }
 
-void physics_t::satisfy_constraint(constraint_t constraint)
+void physics_t::constraint_coeffs(p_constraint_t const &p_constraint, f32 *coeff_a, f32 *coeff_b) const
 {
-    constexpr i32 NUM_ITERATIONS = 16;
+    f32 w_a = *m_db.p_particles.get<pp_inv_mass>(p_constraint.A.particle.index);
+    f32 w_b = *m_db.p_particles.get<pp_inv_mass>(p_constraint.B.particle.index);
+    f32 w = w_a + w_b;
 
-    p_constraint_t const *p_constraint = m_db.p_constraints.get(constraint.index);
+    // Both fixed, nothing moves
+    *coeff_a = (w > 0.0f) ? w_a / w : 0.0f;
+    *coeff_b = (w > 0.0f) ? w_b / w : 0.0f;
+}
 
-    p_particle_t *pa = m_db.p_particles.get(p_constraint->A.particle.index);
-    p_particle_t *pb = m_db.p_particles.get(p_constraint->B.particle.index);
+/// Data index of particle, its row in particle columns.
+static i32 particle_row(p_particles_t const &p_particles, index_t index)
+{
+    return static_cast<i32>(p_particles.get<pp_position_next>(index) - p_particles.column<pp_position_next>());
+}
 
-    f32 length = p_constraint->length;
+/** Counting sort of pair ends by particle row. Row r owns refs
+ *  [offsets[r], offsets[r + 1]), ref 2 k is end a of pair k and 2 k + 1 its
+ *  end b, refs of a row ascend.
+ */
+template <typename T>
+static void sort_pair_ends(std::vector<T> const &pairs, i32 num_rows, std::vector<i32> *offsets, std::vector<i32> *refs)
+{
+    i32 num_pairs = static_cast<i32>(pairs.size());
 
-    for (i32 j = 0; j < NUM_ITERATIONS; ++j) {
+    offsets->assign(num_rows + 1, 0);
+    for (T const &pair : pairs) {
+        (*offsets)[pair.a + 1]++;
+        (*offsets)[pair.b + 1]++;
+    }
+    for (i32 r = 0; r < num_rows; ++r) {
+        (*offsets)[r + 1] += (*offsets)[r];
+    }
 
-        vec3 pa_pos = pa->position.next;
-        vec3 pb_pos = pb->position.next;
+    std::vector<i32> cursor(offsets->begin(), offsets->end() - 1);
+    refs->resize(2 * num_pairs);
+    for (i32 k = 0; k < num_pairs; ++k) {
+        (*refs)[cursor[pairs[k].a]++] = 2 * k;
+        (*refs)[cursor[pairs[k].b]++] = 2 * k + 1;
+    }
+}
 
-        vec3 delta = pb_pos - pa_pos;
-        f32 delta_length = glm::length(delta);
-        f32 diff = (delta_length - length) / delta_length;  // TODO c.L = c.rest_length
+p_solver_constraint_t physics_t::prepare_constraint(p_constraint_t const &p_constraint) const
+{
+    p_solver_constraint_t c {};
+    c.a = particle_row(m_db.p_particles, p_constraint.A.particle.index);
+    c.b = particle_row(m_db.p_particles, p_constraint.B.particle.index);
+    c.length = p_constraint.length;
+    constraint_coeffs(p_constraint, &c.coeff_a, &c.coeff_b);
+    c.inv_mass = *m_db.p_particles.get<pp_inv_mass>(p_constraint.A.particle.index)
+               + *m_db.p_particles.get<pp_inv_mass>(p_constraint.B.particle.index);
+    c.compliance = p_constraint.compliance;
+    return c;
+}
 
-        bool pinned_a = is_pinned(p_constraint->A.particle) || (get_body_type(p_constraint->A.body) == body_type_e::body_static);
-        bool pinned_b = is_pinned(p_constraint->B.particle) || (get_body_type(p_constraint->B.body) == body_type_e::body_static);
+void physics_t::satisfy_constraints(f32 dt)
+{
+    // Multipliers add up over passes of one substep only
+    if (m_solver == solver_e::xpbd) {
+        if (m_colors.dirty) color_constraints();
+        std::fill(m_colors.lambdas.begin(), m_colors.lambdas.end(), 0.0f);
+    }
 
-        f32 coeff_a = 0.5f;
-        f32 coeff_b = 0.5f;
+    // Residual is gathered while projecting, so it tells the error at start
+    // of a pass, a pass within tolerance is the last one.
+    p_residual_t residual;
+    i32 iteration = 0;
 
-        // TODO optimize, someday
-        if (!pinned_a && pinned_b) {
-            coeff_a = 1.0f;
-            coeff_b = 0.0f;
+    while (iteration < m_solver_max_iterations) {
+        if (m_solver == solver_e::gauss_seidel_colored) {
+            residual = satisfy_constraints_colored();
         }
-        else if (pinned_a && !pinned_b) {
-            coeff_a = 0.0f;
-            coeff_b = 1.0f;
+        else if (m_solver == solver_e::xpbd) {
+            residual = satisfy_constraints_xpbd(dt);
         }
-        else if (pinned_a && pinned_b) {
-            coeff_a = 0.0f;
-            coeff_b = 0.0f;
+        else {
+            residual = satisfy_constraints_jacobi();
         }
+        iteration++;
 
-        pa_pos += delta * coeff_a * diff;
-        pb_pos -= delta * coeff_b * diff;
+        if (residual.max <= m_solver_tolerance) break;
+    }
 
-        pa->calculations.position_next.push_back(pa_pos);
-        pb->calculations.position_next.push_back(pb_pos);
+    m_solver_stats.iterations = iteration;
+    m_solver_stats.residual_max = residual.max;
+    m_solver_stats.residual_rms = residual.rms();
+    m_solver_stats.num_steps++;
+    m_solver_stats.num_iterations += iteration;
+    if (iteration < m_solver_max_iterations) m_solver_stats.num_early_exits++;
+}
+
+void physics_t::prepare_jacobi()
+{
+    i32 num_constraints = m_db.p_constraints.size();
+    i32 num_particles = m_db.p_particles.size();
+
+    m_jacobi.constraints.clear();
+    m_jacobi.constraints.reserve(num_constraints);
+    for (p_constraint_t const &p_constraint : m_db.p_constraints) {
+        p_solver_constraint_t c = prepare_constraint(p_constraint);
+        if (!constraint_asleep(c)) m_jacobi.constraints.push_back(c);
     }
+    num_constraints = static_cast<i32>(m_jacobi.constraints.size());
+
+    sort_pair_ends(m_jacobi.constraints, num_particles, &m_jacobi.offsets, &m_jacobi.refs);
+
+    m_jacobi.corrections.resize(2 * num_constraints);
+    m_jacobi.residuals.resize((num_constraints + OGP_PHYSICS_GRAIN - 1) / OGP_PHYSICS_GRAIN);
+
+    m_jacobi.dirty = false;
 }
 
-void physics_t::satisfy_constraints()
+p_residual_t physics_t::satisfy_constraints_jacobi()
 {
+    if (m_jacobi.dirty) prepare_jacobi();
+
+    vec3 *position_next = m_db.p_particles.column<pp_position_next>();
+    p_solver_constraint_t const *constraints = m_jacobi.constraints.data();
+    vec3 *corrections = m_jacobi.corrections.data();
+    p_residual_t *residuals = m_jacobi.residuals.data();
+
+    // Corrections of all constraints from positions at start of pass
+    jobs().parallel_for(0, static_cast<i32>(m_jacobi.constraints.size()), OGP_PHYSICS_GRAIN, [=](i32 begin, i32 end) {
+        p_residual_t residual;
+
+        for (i32 k = begin; k < end; ++k) {
+            p_solver_constraint_t const &c = constraints[k];
+
+            vec3 delta = position_next[c.b] - position_next[c.a];
+            f32 delta_length = glm::length(delta);
+            f32 diff = (delta_length - c.length) / delta_length;  // TODO c.L = c.rest_length
+
+            // Constraints between two fixed particles cannot be corrected, not counted
+            if (c.coeff_a + c.coeff_b > 0.0f) residual.add((delta_length - c.length) / c.length);
+
+            corrections[2 * k + 0] = delta * c.coeff_a * diff;
+            corrections[2 * k + 1] = -(delta * c.coeff_b * diff);
+        }
+
+        residuals[begin / OGP_PHYSICS_GRAIN] = residual;
+    });
+
+    // Every particle averages its own corrections
+    i32 const *offsets = m_jacobi.offsets.data();
+    i32 const *refs = m_jacobi.refs.data();
+
+    jobs().parallel_for(0, m_db.p_particles.size(), OGP_PHYSICS_GRAIN, [=](i32 begin, i32 end) {
+        for (i32 r = begin; r < end; ++r) {
+            i32 count = offsets[r + 1] - offsets[r];
+            if (count == 0) continue;
+
+            vec3 sum {0.0f, 0.0f, 0.0f};
+            for (i32 e = offsets[r]; e < offsets[r + 1]; ++e) {
+                sum += corrections[refs[e]];
+            }
+
+            position_next[r] += sum * (1.0f / count);
+        }
+    });
+
+    // Merged in chunk order, same result with any number of threads
+    p_residual_t residual;
+    for (p_residual_t const &slot : m_jacobi.residuals) {
+        residual.merge(slot);
+    }
+
+    return residual;
+}
+
+void physics_t::prepare_springs()
+{
+    m_springs.springs.clear();
+    m_springs.springs.reserve(m_db.p_springs.size());
+    for (p_spring_t const &p_spring : m_db.p_springs) {
+        p_solver_spring_t s {};
+        s.a = particle_row(m_db.p_particles, p_spring.A.particle.index);
+        s.b = particle_row(m_db.p_particles, p_spring.B.particle.index);
+        s.length = p_spring.length;
+        s.stiffness = p_spring.stiffness;
+        s.damping = p_spring.damping;
+        m_springs.springs.push_back(s);
+    }
+
+    sort_pair_ends(m_springs.springs, m_db.p_particles.size(), &m_springs.offsets, &m_springs.refs);
+    m_springs.forces.resize(2 * m_springs.springs.size());
+
+    m_springs.dirty = false;
+}
+
+void physics_t::satisfy_springs(f32 dt)
+{
+    if (m_db.p_springs.size() == 0) return;
+    if (m_springs.dirty) prepare_springs();
+
+    vec3 const *position_prev = m_db.p_particles.column<pp_position_prev>();
+    vec3 const *position_now = m_db.p_particles.column<pp_position_now>();
+    p_solver_spring_t const *springs = m_springs.springs.data();
+    vec3 *forces = m_springs.forces.data();
+    f32 inv_dt = 1.0f / dt;
+
+    // Forces of all springs at once, no branches, no writes to particles.
+    // Sleeping and fixed particles get forces too, integration drops them.
+    jobs().parallel_for(0, static_cast<i32>(m_springs.springs.size()), OGP_PHYSICS_GRAIN, [=](i32 begin, i32 end) {
+        for (i32 k = begin; k < end; ++k) {
+            p_solver_spring_t const &s = springs[k];
+
+            vec3 delta = position_now[s.b] - position_now[s.a];
+            vec3 velocity = (delta - (position_prev[s.b] - position_prev[s.a])) * inv_dt;
+
+            f32 length = glm::length(delta);
+            vec3 direction = delta * (1.0f / std::max(length, 1e-6f));
+
+            // Hooke's law, damping only along the spring, it does not slow rotation
+            f32 magnitude = s.stiffness * (length - s.length) + s.damping * glm::dot(velocity, direction);
+
+            forces[2 * k + 0] = direction * magnitude;
+            forces[2 * k + 1] = -(direction * magnitude);
+        }
+    });
+
+    // Every particle sums its own spring forces
+    vec3 *force = m_db.p_particles.column<pp_force>();
+    i32 const *offsets = m_springs.offsets.data();
+    i32 const *refs = m_springs.refs.data();
+
+    jobs().parallel_for(0, m_db.p_particles.size(), OGP_PHYSICS_GRAIN, [=](i32 begin, i32 end) {
+        for (i32 r = begin; r < end; ++r) {
+            for (i32 e = offsets[r]; e < offsets[r + 1]; ++e) {
+                force[r] += forces[refs[e]];
+            }
+        }
+    });
+}
+
+void physics_t::color_constraints()
+{
+    constexpr i32 MAX_COLORS = 64;  // one bit each in a particle mask
+    constexpr i32 SERIAL = MAX_COLORS;
+
+    i32 num_constraints = m_db.p_constraints.size();
+
+    std::vector<u64> particle_colors(m_db.p_particles.size(), 0);
+    std::vector<p_solver_constraint_t> prepared(num_constraints);
+    std::vector<i32> constraint_colors(num_constraints);
+    std::vector<i32> counts(MAX_COLORS + 1, 0);
+
+    // Greedy, lowest color free at both particles
+    i32 num_colors = 0;
+    i32 i = 0;
     for (p_constraint_t const &p_constraint : m_db.p_constraints) {
-        satisfy_constraint(p_constraint.constraint);
+        p_solver_constraint_t &c = prepared[i];
+        c = prepare_constraint(p_constraint);
+        if (constraint_asleep(c)) continue;
+
+        u64 free_colors = ~(particle_colors[c.a] | particle_colors[c.b]);
+        i32 color = SERIAL;
+        if (free_colors != 0) {
+            color = __builtin_ctzll(free_colors);
+            particle_colors[c.a] |= u64(1) << color;
+            particle_colors[c.b] |= u64(1) << color;
+            num_colors = std::max(num_colors, color + 1);
+        }
+
+        constraint_colors[i] = color;
+        counts[color]++;
+        i++;
+    }
+    num_constraints = i;
+
+    // Counting sort by color, serial ones go last
+    std::vector<i32> cursor(MAX_COLORS + 1, 0);
+    m_colors.offsets.assign(num_colors + 1, 0);
+    for (i32 color = 0, offset = 0; color <= MAX_COLORS; ++color) {
+        cursor[color] = offset;
+        if (color <= num_colors) m_colors.offsets[color] = offset;
+        offset += counts[color];
+    }
+
+    m_colors.constraints.resize(num_constraints);
+    for (i32 k = 0; k < num_constraints; ++k) {
+        m_colors.constraints[cursor[constraint_colors[k]]++] = prepared[k];
     }
 
-    // TODO only for constrained particles
-    for (p_particle_t &p_particle : m_db.p_particles) {
-        size_t s = p_particle.calculations.position_next.size();
-        if (s == 0) continue;
-        auto begin = std::begin(p_particle.calculations.position_next);
-        auto end = std::end(p_particle.calculations.position_next);
-        vec3 pos = std::accumulate(begin, end, vec3 {0.0f, 0.0f, 0.0f});
-        pos = pos * (1.0f / s);
+    m_colors.num_serial = counts[SERIAL];
 
-        p_particle.position.next = pos;
-        p_particle.calculations.position_next.clear();
+    // Residual slot per parallel chunk, chunks of a color are fixed by grain
+    m_colors.chunk_base.assign(num_colors + 1, 0);
+    for (i32 color = 0; color < num_colors; ++color) {
+        i32 count = m_colors.offsets[color + 1] - m_colors.offsets[color];
+        m_colors.chunk_base[color + 1] = m_colors.chunk_base[color] + (count + OGP_PHYSICS_GRAIN - 1) / OGP_PHYSICS_GRAIN;
     }
+    m_colors.residuals.resize(m_colors.chunk_base[num_colors] + 1);
+    m_colors.lambdas.assign(num_constraints, 0.0f);
+
+    m_colors.dirty = false;
+
+    ogp_log_debug("Constraints colored: %d constraints, %d colors, %d serial", num_constraints, num_colors, m_colors.num_serial);
 }
 
-void physics_t::step(f32 dt)
+template <typename F>
+void physics_t::parallel_for_awake(F const &fn)
+{
+    i32 num = m_db.p_particles.size();
+    bool built = m_sleeping && !m_islands.dirty && static_cast<i32>(m_islands.row_asleep.size()) == num;
+    if (!built) {
+        jobs().parallel_for(0, num, OGP_PHYSICS_GRAIN, fn);
+        return;
+    }
+
+    std::vector<i32> const &spans = m_islands.awake_spans;
+    std::vector<i32> const &chunks = m_islands.awake_chunks;
+    i32 num_chunks = static_cast<i32>(chunks.size()) - 1;
+
+    jobs().parallel_for(0, num_chunks, 1, [&spans, &chunks, &fn](i32 begin, i32 end) {
+        for (i32 c = begin; c < end; ++c) {
+            for (i32 s = chunks[c]; s < chunks[c + 1]; ++s) fn(spans[2 * s], spans[2 * s + 1]);
+        }
+    });
+}
+
+template <typename F>
+p_residual_t physics_t::project_colored(F const &project)
 {
-    for (body_t const &body : m_user_db.dynamic_bodies) {
-        add_force(body, m_gravity);
+    i32 num_colors = static_cast<i32>(m_colors.offsets.size()) - 1;
+    i32 serial_begin = m_colors.offsets[num_colors];
+
+    p_residual_t *residuals = m_colors.residuals.data();
+    std::fill(m_colors.residuals.begin(), m_colors.residuals.end(), p_residual_t {});
+
+    // Colors one after another, constraints of one color at once
+    for (i32 color = 0; color < num_colors; ++color) {
+        i32 first = m_colors.offsets[color];
+        p_residual_t *slots = residuals + m_colors.chunk_base[color];
+
+        jobs().parallel_for(first, m_colors.offsets[color + 1], OGP_PHYSICS_GRAIN, [&project, first, slots](i32 begin, i32 end) {
+            project(begin, end, &slots[(begin - first) / OGP_PHYSICS_GRAIN]);
+        });
     }
 
-    // TODO satisfy_springs
+    project(serial_begin, serial_begin + m_colors.num_serial, &m_colors.residuals.back());
 
-    for (body_t const &body : m_user_db.dynamic_bodies) {
-        solve_verlet(body, dt);
+    // Merged in slot order, same result with any number of threads
+    p_residual_t residual;
+    for (p_residual_t const &slot : m_colors.residuals) {
+        residual.merge(slot);
     }
 
-    satisfy_constraints();
+    return residual;
+}
+
+p_residual_t physics_t::satisfy_constraints_colored()
+{
+    if (m_colors.dirty) color_constraints();
+
+    vec3 *position_next = m_db.p_particles.column<pp_position_next>();
+    p_solver_constraint_t const *constraints = m_colors.constraints.data();
 
-    for (body_t const &body : m_user_db.dynamic_bodies) {
-        set_force(body, {0.0f, 0.0f, 0.0f});
+    return project_colored([position_next, constraints](i32 begin, i32 end, p_residual_t *residual) {
+        for (i32 k = begin; k < end; ++k) {
+            p_solver_constraint_t const &c = constraints[k];
+            vec3 &pa = position_next[c.a];
+            vec3 &pb = position_next[c.b];
+
+            vec3 delta = pb - pa;
+            f32 delta_length = glm::length(delta);
+            f32 diff = (delta_length - c.length) / delta_length;
+
+            if (c.coeff_a + c.coeff_b > 0.0f) residual->add((delta_length - c.length) / c.length);
+
+            pa += delta * c.coeff_a * diff;
+            pb -= delta * c.coeff_b * diff;
+        }
+    });
+}
+
+p_residual_t physics_t::satisfy_constraints_xpbd(f32 dt)
+{
+    if (m_colors.dirty) color_constraints();
+
+    vec3 *position_next = m_db.p_particles.column<pp_position_next>();
+    p_solver_constraint_t const *constraints = m_colors.constraints.data();
+    f32 *lambdas = m_colors.lambdas.data();
+    f32 inv_dt2 = 1.0f / (dt * dt);
+
+    return project_colored([position_next, constraints, lambdas, inv_dt2](i32 begin, i32 end, p_residual_t *residual) {
+        for (i32 k = begin; k < end; ++k) {
+            p_solver_constraint_t const &c = constraints[k];
+            vec3 &pa = position_next[c.a];
+            vec3 &pb = position_next[c.b];
+
+            vec3 delta = pb - pa;
+            f32 delta_length = glm::length(delta);
+            f32 error = delta_length - c.length;
+
+            // Both fixed, nothing moves
+            if (c.inv_mass <= 0.0f) continue;
+            residual->add(error / c.length);
+
+            // Compliance scaled by time step, multiplier change of this pass
+            f32 alpha = c.compliance * inv_dt2;
+            f32 d_lambda = (-error - alpha * lambdas[k]) / (c.inv_mass + alpha);
+            lambdas[k] += d_lambda;
+
+            vec3 step = delta * (c.inv_mass * d_lambda / delta_length);
+            pa -= step * c.coeff_a;
+            pb += step * c.coeff_b;
+        }
+    });
+}
+
+void physics_t::defragment_rows()
+{
+    // Cloth resets remove and add thousands of elements, keep them in
+    // creation order, so constraints walk particles forward in memory.
+    bool moved = false;
+    if (m_db.p_particles.churn() > OGP_PHYSICS_DEFRAG_CHURN * std::max(m_db.p_particles.size(), 1)) {
+        m_db.p_particles.defragment(defrag_order_e::creation);
+        moved = true;
     }
+    if (m_db.p_constraints.churn() > OGP_PHYSICS_DEFRAG_CHURN * std::max(m_db.p_constraints.size(), 1)) {
+        m_db.p_constraints.defragment(defrag_order_e::creation);
+        moved = true;
+    }
+
+    if (moved) mark_constraints_dirty();
+}
+
+void physics_t::step(f32 dt)
+{
+    defragment_rows();
+
+    f32 h = dt / m_substeps;
+    i32 num = m_db.p_particles.size();
+    vec3 *force = m_db.p_particles.column<pp_force>();
+
+    // Springs add to forces every substep, external ones are set once per step
+    if (m_substeps > 1) {
+        m_step_forces.resize(num);
+        std::copy(force, force + num, m_step_forces.begin());
+    }
+
+    for (i32 s = 0; s < m_substeps; ++s) {
+        if (s > 0) std::copy(m_step_forces.begin(), m_step_forces.end(), force);
+        substep(h);
+    }
+
+    // Forces are used up
+    jobs().parallel_for(0, num, OGP_PHYSICS_GRAIN, [force](i32 begin, i32 end) {
+        std::fill(force + begin, force + end, vec3 {0.0f, 0.0f, 0.0f});
+    });
+
+    // Velocity of last substep tells if island is still
+    update_sleep(h);
+
+    m_frame++;
+}
+
+void physics_t::substep(f32 dt)
+{
+    if (m_sleeping && m_islands.dirty) build_islands();
+
+    satisfy_springs(dt);
+
+    // Gravity is added to force of integrated (dynamic) particles inside
+    solve_verlet(dt);
+
+    satisfy_constraints(dt);
+
+    collide_particles();
+
+    collide_shapes();
 
     satisfy_pins();
 
-    for (body_t const &body : m_user_db.dynamic_bodies) {
-        make_move(body);
+    make_move();
+}
+
+void physics_t::collide_particles()
+{
+    i32 num = m_db.p_particles.size();
+    if (!m_collisions || num < 2) return;
+
+    // Sleeping particles resting on each other stay as they are
+    if (m_sleeping && m_islands.num_awake == 0) return;
+
+    vec3 *position_next = m_db.p_particles.column<pp_position_next>();
+    vec3 const *position_rest = m_db.p_particles.column<pp_position_rest>();
+    f32 const *radius = m_db.p_particles.column<pp_radius>();
+    f32 const *inv_mass = m_db.p_particles.column<pp_inv_mass>();
+    body_t const *body = m_db.p_particles.column<pp_body>();
+    vec3 *correction_sum = m_db.p_particles.column<pp_correction_sum>();
+
+    // Cell as wide as the largest contact distance, contacts are in 3x3x3 cells
+    f32 max_radius = *std::max_element(radius, radius + num);
+    if (max_radius <= 0.0f) return;  // points never touch
+
+    m_broadphase.build(position_next, num, 2.0f * max_radius);
+
+    spatial_hash_t const &broadphase = m_broadphase;
+
+    // Contact of two particles, skipping pairs of one body that close at rest
+    auto touching = [&](i32 i, i32 j, vec3 *delta, f32 *d2) {
+        f32 contact = radius[i] + radius[j];
+        *delta = position_next[i] - position_next[j];
+        *d2 = glm::dot(*delta, *delta);
+        if (*d2 >= contact * contact || *d2 == 0.0f) return false;
+
+        if (body[i] == body[j]) {
+            vec3 rest = position_rest[i] - position_rest[j];
+            if (glm::dot(rest, rest) < contact * contact) return false;
+        }
+        return true;
+    };
+
+    // Asleep rows hold still, awake rows touching them flag themselves
+    bool built = m_sleeping && !m_islands.dirty && static_cast<i32>(m_islands.row_asleep.size()) == num;
+    u8 const *row_asleep = built ? m_islands.row_asleep.data() : nullptr;
+    if (built) m_islands.row_touched.assign(num, 0);
+    u8 *row_touched = m_islands.row_touched.data();
+    std::atomic<bool> any_touched {false};
+
+    // Every particle sums pushes from all its contacts and writes its own
+    // row only, Jacobi style, so particles run in parallel in any order
+    parallel_for_awake([&](i32 begin, i32 end) {
+        for (i32 i = begin; i < end; ++i) {
+            f32 w_i = inv_mass[i];
+            if (w_i == 0.0f) continue;
+
+            vec3 push {0.0f, 0.0f, 0.0f};
+            i32 num_contacts = 0;
+            bool touched = false;
+
+            broadphase.query(position_next[i], [&](i32 j) {
+                vec3 delta;
+                f32 d2;
+                if (j == i || !touching(i, j, &delta, &d2)) return;
+
+                touched = touched || (row_asleep != nullptr && row_asleep[j] != 0);
+
+                f32 contact = radius[i] + radius[j];
+                f32 d = std::sqrt(d2);
+                push += delta * ((contact - d) / d * w_i / (w_i + inv_mass[j]));
+                num_contacts++;
+            });
+
+            if (num_contacts > 0) correction_sum[i] = push * (1.0f / num_contacts);
+            if (touched) {
+                row_touched[i] = 1;
+                any_touched.store(true, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    parallel_for_awake([&](i32 begin, i32 end) {
+        for (i32 i = begin; i < end; ++i) {
+            position_next[i] += correction_sum[i];
+            correction_sum[i] = vec3 {0.0f, 0.0f, 0.0f};
+        }
+    });
+
+    if (!any_touched.load()) return;
+
+    // Islands of asleep rows touched by awake ones wake, in row order
+    bool changed = false;
+    for (size_t s = 0; s < m_islands.awake_spans.size(); s += 2) {
+        for (i32 i = m_islands.awake_spans[s]; i < m_islands.awake_spans[s + 1]; ++i) {
+            if (row_touched[i] == 0) continue;
+
+            broadphase.query(position_next[i], [&](i32 j) {
+                vec3 delta;
+                f32 d2;
+                if (j == i || row_asleep[j] == 0 || !touching(i, j, &delta, &d2)) return;
+
+                i32 island = m_islands.row_island[j];
+                if (island < 0 || !m_islands.islands[island].sleeping) return;
+                wake_island(m_islands.islands[island]);
+                changed = true;
+            });
+        }
+    }
+    if (changed) count_awake();
+}
+
+/** Stop particles of [begin, end) moving more than their radius at first
+ *  contact on their way from now to next position, the rest of the move
+ *  slides along the surface. Slow particles only pay for the distance check,
+ *  a step shorter than radius cannot pass through anything.
+ *  Meshes are hit with a ray of the center, backed off by radius along hit
+ *  normal, push out catches spheres grazing triangle edges.
+ */
+static void sweep_fast_particles(collider_columns_t const &columns, vec3 const *position_now, i32 begin, i32 end,
+                                 collider_shapes_t const &shapes, std::vector<bvh_t const *> const &meshes)
+{
+    for (i32 i = begin; i < end; ++i) {
+        vec3 from = position_now[i];
+        vec3 delta = columns.position_next[i] - from;
+        f32 radius = columns.radius[i];
+        if (glm::dot(delta, delta) <= radius * radius || columns.inv_mass[i] == 0.0f) continue;
+
+        vec3 normal {0.0f, 0.0f, 0.0f};
+        f32 t = sweep_shapes(from, delta, radius, shapes, &normal);
+
+        for (bvh_t const *bvh : meshes) {
+            ray_hit_t hit;
+            if (!bvh->raycast(from, delta, 1.0f, &hit)) continue;
+
+            f32 approach = -glm::dot(delta, hit.normal);
+            f32 contact = (approach > 0.0f) ? std::max(hit.t - radius / approach, 0.0f) : hit.t;
+            if (contact >= t) continue;
+
+            t = contact;
+            normal = hit.normal;
+        }
+
+        if (t >= 1.0f) continue;
+
+        vec3 rest = delta * (1.0f - t);
+        rest -= normal * std::min(glm::dot(rest, normal), 0.0f);
+        columns.position_next[i] = from + delta * t + rest;
+    }
+}
+
+void physics_t::collide_shapes()
+{
+    if (m_db.p_colliders.size() == 0) return;
+
+    if (m_shapes.dirty) {
+        m_shapes.planes.clear();
+        m_shapes.spheres.clear();
+        m_shapes.capsules.clear();
+        m_shapes.boxes.clear();
+        m_shapes.meshes.clear();
+
+        for (p_collider_t const &p_collider : m_db.p_colliders) {
+            switch (p_collider.type) {
+                case collider_type_e::plane: m_shapes.planes.push_back(p_collider.plane); break;
+                case collider_type_e::sphere: m_shapes.spheres.push_back(p_collider.sphere); break;
+                case collider_type_e::capsule: m_shapes.capsules.push_back(p_collider.capsule); break;
+                case collider_type_e::box: m_shapes.boxes.push_back(p_collider.box); break;
+                case collider_type_e::mesh: m_shapes.meshes.push_back(m_db.p_meshes.get(p_collider.mesh)); break;
+            }
+        }
+        m_shapes.dirty = false;
+    }
+
+    collider_shapes_t shapes;
+    shapes.planes = m_shapes.planes.data();
+    shapes.spheres = m_shapes.spheres.data();
+    shapes.capsules = m_shapes.capsules.data();
+    shapes.boxes = m_shapes.boxes.data();
+    shapes.num_planes = static_cast<i32>(m_shapes.planes.size());
+    shapes.num_spheres = static_cast<i32>(m_shapes.spheres.size());
+    shapes.num_capsules = static_cast<i32>(m_shapes.capsules.size());
+    shapes.num_boxes = static_cast<i32>(m_shapes.boxes.size());
+
+    collider_columns_t columns;
+    columns.position_next = m_db.p_particles.column<pp_position_next>();
+    columns.radius = m_db.p_particles.column<pp_radius>();
+    columns.inv_mass = m_db.p_particles.column<pp_inv_mass>();
+
+    std::vector<bvh_t const *> const &meshes = m_shapes.meshes;
+    vec3 const *position_now = m_db.p_particles.column<pp_position_now>();
+
+    parallel_for_awake([&columns, &shapes, &meshes, position_now](i32 begin, i32 end) {
+        sweep_fast_particles(columns, position_now, begin, end, shapes, meshes);
+        ogp::collide_shapes(columns, begin, end, shapes);
+
+        for (bvh_t const *bvh : meshes) {
+            for (i32 i = begin; i < end; ++i) {
+                if (columns.inv_mass[i] > 0.0f) bvh->push_out(&columns.position_next[i], columns.radius[i], position_now[i]);
+            }
+        }
+    });
+}
+
+void physics_t::set_substeps(i32 substeps)
+{
+    if (substeps < 1) {
+        ogp_log_error("Number of substeps should be positive: %d", substeps);
+        return;
+    }
+    m_substeps = substeps;
+}
+
+void physics_t::set_solver(solver_e solver, i32 max_iterations, f32 tolerance)
+{
+    m_solver = solver;
+    m_solver_max_iterations = std::max(1, max_iterations);
+    m_solver_tolerance = std::max(0.0f, tolerance);
+}
+
+f32 physics_t::constraint_error() const
+{
+    i32 num = m_db.p_constraints.size();
+    if (num == 0) return 0.0f;
+
+    double sum = 0.0;
+    for (p_constraint_t const &p_constraint : m_db.p_constraints) {
+        vec3 pa = *m_db.p_particles.get<pp_position_now>(p_constraint.A.particle.index);
+        vec3 pb = *m_db.p_particles.get<pp_position_now>(p_constraint.B.particle.index);
+        double error = (glm::distance(pa, pb) - p_constraint.length) / p_constraint.length;
+        sum += error * error;
+    }
+
+    return static_cast<f32>(std::sqrt(sum / num));
+}
+
+/// FNV-1a over 32 bit words.
+static u64 hash_words(u64 hash, u32 const *words, i32 num)
+{
+    for (i32 i = 0; i < num; ++i) {
+        hash = (hash ^ words[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+u64 physics_t::state_hash() const
+{
+    static_assert(sizeof(vec3) == 3 * sizeof(u32), "positions are hashed as flat 32 bit words");
+    constexpr u64 FNV_BASIS = 0xcbf29ce484222325ull;
+
+    i32 num = m_db.p_particles.size();
+    vec3 const *position_prev = m_db.p_particles.column<pp_position_prev>();
+    vec3 const *position_now = m_db.p_particles.column<pp_position_now>();
+
+    m_hash_chunks.resize((num + OGP_PHYSICS_GRAIN - 1) / OGP_PHYSICS_GRAIN);
+    u64 *chunks = m_hash_chunks.data();
+
+    // Chunks are fixed by grain, not by number of threads
+    jobs().parallel_for(0, num, OGP_PHYSICS_GRAIN, [=](i32 begin, i32 end) {
+        u32 words[3];
+        u64 hash = FNV_BASIS;
+        for (i32 r = begin; r < end; ++r) {
+            std::memcpy(words, &position_now[r], sizeof(words));
+            hash = hash_words(hash, words, 3);
+            std::memcpy(words, &position_prev[r], sizeof(words));
+            hash = hash_words(hash, words, 3);
+        }
+        chunks[begin / OGP_PHYSICS_GRAIN] = hash;
+    });
+
+    u32 count = static_cast<u32>(num);
+    u64 hash = hash_words(FNV_BASIS, &count, 1);
+    for (u64 chunk : m_hash_chunks) {
+        u32 words[2] = {static_cast<u32>(chunk), static_cast<u32>(chunk >> 32)};
+        hash = hash_words(hash, words, 2);
     }
+    return hash;
 }
 
 body_t physics_t::create_body(body_type_e body_type)
@@ -146,6 +817,8 @@ body_t physics_t::create_body(body_type_e body_type)
 
 void physics_t::destroy_body(body_t body)
 {
+    mark_constraints_dirty();
+
     p_body_t *p_body = m_db.p_bodies.get(body.index);
     NULL_WARNING(p_body);
 
@@ -158,45 +831,57 @@ void physics_t::destroy_body(body_t body)
     // in this order:
     // [x] 1. destroy related constraints
     // [x] 2. destroy related pins
-    // [x] 3. destroy related particles
-    // [x] 4. destroy body and its edges
+    // [x] 3. destroy related springs
+    // [x] 4. destroy related particles
+    // [x] 5. destroy body and its edges
 
     // (1) DESTROY BODY RELATED CONSTRAINTS ....................................
 
-    std::vector<constraint_t> constraints_to_remove;
     for (p_constraint_t const &p_constraint : m_db.p_constraints) {
         bool test_a = (body.index == p_constraint.A.body.index);
         bool test_b = (body.index == p_constraint.B.body.index);
         if (test_a || test_b) {
-            constraints_to_remove.push_back(p_constraint.constraint);
+            m_db.p_constraints.mark_removed(p_constraint.constraint.index);
         }
     }
-    for (constraint_t const &constraint : constraints_to_remove) {
-        destroy_constraint(constraint);
-    }
+    m_db.p_constraints.compact();
 
     // (2) DESTROY BODY RELATED PINS ...........................................
 
-    std::vector<pin_t> pins_to_remove;
     for (p_pin_t const &p_pin : m_db.p_pins) {
         bool test_master = (body.index == p_pin.master.body.index);
         bool test_slave = (body.index == p_pin.slave.body.index);
         if (test_master || test_slave) {
-            pins_to_remove.push_back(p_pin.pin);
+            (*m_db.p_particles.get<pp_num_pins>(p_pin.slave.particle.index))--;
+            update_particle_state(p_pin.slave.particle);
+            m_db.p_pins.mark_removed(p_pin.pin.index);
         }
     }
-    for (pin_t const &pin : pins_to_remove) {
-        destroy_pin(pin);
-    }
+    m_db.p_pins.compact();
 
-    // (3) DESTROY RELATED PARTICLES ...........................................
+    // (3) DESTROY BODY RELATED SPRINGS ........................................
 
-    for (particle_t const &particle : p_body->particles) {
-        m_db.p_particles.remove_index(particle.index);
+    for (p_spring_t const &p_spring : m_db.p_springs) {
+        bool test_a = (body.index == p_spring.A.body.index);
+        bool test_b = (body.index == p_spring.B.body.index);
+        if (test_a || test_b) {
+            wake_body(test_a ? p_spring.B.body : p_spring.A.body);
+            m_db.p_springs.mark_removed(p_spring.spring.index);
+        }
     }
-    p_body->particles.clear();
+    m_db.p_springs.compact();
+
+    // (4) DESTROY RELATED PARTICLES ...........................................
+
+    for_each_body_particle(*p_body, [this](particle_t particle) {
+        m_db.p_particles.mark_removed(particle.index);
+    });
+    m_db.p_particles.compact();
+    p_body->first_particle = particle_t {};
+    p_body->last_particle = particle_t {};
+    p_body->num_particles = 0;
 
-    // (4) DESTROY BODY ........................................................
+    // (5) DESTROY BODY ........................................................
 
     if (p_body->body_type == body_type_e::body_dynamic) {
         m_user_db.dynamic_bodies.remove_element(body);
@@ -214,6 +899,8 @@ void physics_t::destroy_body(body_t body)
 
 void physics_t::set_body_type(body_t body, body_type_e body_type)
 {
+    mark_constraints_dirty();
+
     p_body_t *p_body = m_db.p_bodies.get(body.index);
     NULL_WARNING(p_body);
     if (p_body == nullptr) return;
@@ -224,6 +911,10 @@ void physics_t::set_body_type(body_t body, body_type_e body_type)
 
     p_body->body_type = body_type;
 
+    for_each_body_particle(*p_body, [this](particle_t particle) {
+        update_particle_state(particle);
+    });
+
     if (body_type == body_type_e::body_dynamic) {
         m_user_db.dynamic_bodies.add(body);
     }
@@ -251,10 +942,11 @@ void physics_t::set_force(body_t body, vec3 force)
     NULL_WARNING(p_body);
     if (p_body == nullptr) return;
 
-    for (particle_t const &particle : p_body->particles) {
-        p_particle_t *p_particle = m_db.p_particles.get(particle.index);
-        p_particle->force = force;
-    }
+    if (force != vec3 {0.0f, 0.0f, 0.0f}) wake_body(body);
+
+    for_each_body_particle(*p_body, [this, force](particle_t particle) {
+        *m_db.p_particles.get<pp_force>(particle.index) = force;
+    });
 }
 
 void physics_t::add_force(body_t body, vec3 force)
@@ -263,20 +955,21 @@ void physics_t::add_force(body_t body, vec3 force)
     NULL_WARNING(p_body);
     if (p_body == nullptr) return;
 
-    for (particle_t const &particle : p_body->particles) {
-        p_particle_t *p_particle = m_db.p_particles.get(particle.index);
-        p_particle->force += force;
-    }
+    if (force != vec3 {0.0f, 0.0f, 0.0f}) wake_body(body);
+
+    for_each_body_particle(*p_body, [this, force](particle_t particle) {
+        *m_db.p_particles.get<pp_force>(particle.index) += force;
+    });
 }
 
 vec3 physics_t::get_particle_pos(particle_t particle, f32 frame_dt)
 {
-    p_particle_t const *p_particle = m_db.p_particles.get(particle.index);
-    NULL_WARNING(p_particle);
-    if (p_particle == nullptr) return vec3 {0.0f, 0.0f, 0.0f};
+    vec3 const *prev = m_db.p_particles.get<pp_position_prev>(particle.index);
+    NULL_WARNING(prev);
+    if (prev == nullptr) return vec3 {0.0f, 0.0f, 0.0f};
 
-    vec3 now = p_particle->position.prev;
-    vec3 next = p_particle->position.next;
+    vec3 now = *prev;
+    vec3 next = *m_db.p_particles.get<pp_position_next>(particle.index);
 
     vec3 interp = now + (next - now) * frame_dt;
     return interp;
@@ -284,61 +977,420 @@ vec3 physics_t::get_particle_pos(particle_t particle, f32 frame_dt)
 
 void physics_t::set_particle_pos(particle_t particle, vec3 pos)
 {
-    p_particle_t *p_particle = m_db.p_particles.get(particle.index);
-    NULL_WARNING(p_particle);
-    if (p_particle == nullptr) return;
+    vec3 *prev = m_db.p_particles.get<pp_position_prev>(particle.index);
+    NULL_WARNING(prev);
+    if (prev == nullptr) return;
+
+    *prev = pos;
+    *m_db.p_particles.get<pp_position_now>(particle.index) = pos;
+    *m_db.p_particles.get<pp_position_next>(particle.index) = pos;
+
+    wake_body(*m_db.p_particles.get<pp_body>(particle.index));
+}
+
+void physics_t::set_particle_radius(particle_t particle, f32 radius)
+{
+    f32 *p_radius = m_db.p_particles.get<pp_radius>(particle.index);
+    NULL_WARNING(p_radius);
+    if (p_radius == nullptr) return;
 
-    p_particle->position.prev = pos;
-    p_particle->position.now  = pos;
-    p_particle->position.next = pos;
+    *p_radius = std::max(0.0f, radius);
 }
 
-void physics_t::solve_verlet(body_t body, f32 dt)
+void physics_t::set_particle_mass(particle_t particle, f32 mass)
 {
-    p_body_t *p_body = m_db.p_bodies.get(body.index);
-    NULL_WARNING(p_body);
-    if (p_body == nullptr) return;
+    f32 *p_mass = m_db.p_particles.get<pp_mass>(particle.index);
+    NULL_WARNING(p_mass);
+    if (p_mass == nullptr) return;
 
-    for (particle_t const &particle : p_body->particles) {
+    if (mass <= 0.0f) {
+        ogp_log_error("Particle mass should be positive: %f", mass);
+        return;
+    }
 
-        if (is_pinned(particle)) continue;
+    mark_constraints_dirty();
+    wake_body(*m_db.p_particles.get<pp_body>(particle.index));
 
-        p_particle_t *p = m_db.p_particles.get(particle.index);
-        vec3 r_now  = p->position.now;
-        vec3 r_prev = p->position.prev;
+    *p_mass = mass;
+    update_particle_state(particle);
+}
 
-        vec3 a_now = p->force / p->mass;
+void physics_t::solve_verlet(f32 dt)
+{
+    verlet_columns_t columns;
+    columns.position_prev = m_db.p_particles.column<pp_position_prev>();
+    columns.position_now = m_db.p_particles.column<pp_position_now>();
+    columns.position_next = m_db.p_particles.column<pp_position_next>();
+    columns.velocity_next = m_db.p_particles.column<pp_velocity_next>();
+    columns.force = m_db.p_particles.column<pp_force>();
+    columns.mass = m_db.p_particles.column<pp_mass>();
+    columns.integrate = m_db.p_particles.column<pp_integrate>();
+
+    parallel_for_awake([&](i32 begin, i32 end) {
+        verlet_integrate(columns, begin, end, m_gravity, dt);
+    });
+}
 
-        vec3 r_next = r_now * 2.0f - r_prev + a_now * dt * dt;
-        vec3 v_next = (r_next - r_prev) * (1.0f / dt) * 0.5f;
+void physics_t::make_move()
+{
+    vec3 *position_prev = m_db.p_particles.column<pp_position_prev>();
+    vec3 *position_now = m_db.p_particles.column<pp_position_now>();
+    vec3 const *position_next = m_db.p_particles.column<pp_position_next>();
+    vec3 *velocity_now = m_db.p_particles.column<pp_velocity_now>();
+    vec3 const *velocity_next = m_db.p_particles.column<pp_velocity_next>();
+
+    parallel_for_awake([&](i32 begin, i32 end) {
+        std::copy(position_now + begin, position_now + end, position_prev + begin);
+        std::copy(position_next + begin, position_next + end, position_now + begin);
+        std::copy(velocity_next + begin, velocity_next + end, velocity_now + begin);
+    });
+}
+
+bool physics_t::constraint_asleep(p_solver_constraint_t const &c) const
+{
+    i32 num = static_cast<i32>(m_islands.row_asleep.size());
+    f32 const *inv_mass = m_db.p_particles.column<pp_inv_mass>();
+
+    bool awake_a = inv_mass[c.a] > 0.0f && (c.a >= num || m_islands.row_asleep[c.a] == 0);
+    bool awake_b = inv_mass[c.b] > 0.0f && (c.b >= num || m_islands.row_asleep[c.b] == 0);
+    return !awake_a && !awake_b;
+}
+
+void physics_t::build_islands()
+{
+    i32 num = m_db.p_particles.size();
+
+    std::vector<i32> parent(num);
+    std::iota(parent.begin(), parent.end(), 0);
+    std::vector<u8> dynamic(num, 0);
+    std::vector<u8> restless(num, 0);
+    std::vector<particle_t> row_particle(num);
+
+    auto find = [&parent](i32 r) {
+        while (parent[r] != r) {
+            parent[r] = parent[parent[r]];
+            r = parent[r];
+        }
+        return r;
+    };
+
+    // Lower row is the root, islands do not depend on order of unions
+    auto unite = [&parent, &find](i32 a, i32 b) {
+        a = find(a);
+        b = find(b);
+        if (a != b) parent[std::max(a, b)] = std::min(a, b);
+    };
+
+    auto row = [this](particle_t particle) {
+        return particle_row(m_db.p_particles, particle.index);
+    };
+
+    // Particles of a body are one island even without constraints
+    for (p_body_t const &p_body : m_db.p_bodies) {
+        if (p_body.body_type != body_type_e::body_dynamic || p_body.num_particles == 0) continue;
+
+        i32 first = row(p_body.first_particle);
+        for_each_body_particle(p_body, [&](particle_t particle) {
+            i32 r = row(particle);
+            dynamic[r] = 1;
+            row_particle[r] = particle;
+            unite(first, r);
+        });
+    }
+
+    // Static ends do not join islands, kinematic ones keep them awake
+    auto link = [&](body_t body_a, i32 a, body_t body_b, i32 b) {
+        if (dynamic[a] && dynamic[b]) {
+            unite(a, b);
+            return;
+        }
+        if (dynamic[a] && get_body_type(body_b) == body_type_e::body_kinematic) restless[a] = 1;
+        if (dynamic[b] && get_body_type(body_a) == body_type_e::body_kinematic) restless[b] = 1;
+    };
+
+    for (p_constraint_t const &p_constraint : m_db.p_constraints) {
+        link(p_constraint.A.body, row(p_constraint.A.particle), p_constraint.B.body, row(p_constraint.B.particle));
+    }
+    for (p_spring_t const &p_spring : m_db.p_springs) {
+        link(p_spring.A.body, row(p_spring.A.particle), p_spring.B.body, row(p_spring.B.particle));
+    }
+    for (p_pin_t const &p_pin : m_db.p_pins) {
+        link(p_pin.master.body, row(p_pin.master.particle), p_pin.slave.body, row(p_pin.slave.particle));
+    }
+
+    // Islands numbered by their lowest row, particles grouped by counting sort
+    std::vector<i32> island_of(num, -1);
+    m_islands.islands.clear();
+    for (i32 r = 0; r < num; ++r) {
+        if (!dynamic[r]) continue;
+
+        i32 root = find(r);
+        if (island_of[root] == -1) {
+            island_of[root] = static_cast<i32>(m_islands.islands.size());
+            m_islands.islands.push_back(p_island_t {0, 0});
+        }
+        p_island_t &island = m_islands.islands[island_of[root]];
+        island.count++;
+        island.restless = island.restless || restless[r];
+    }
 
-        p->position.next = r_next;
-        p->velocity.next = v_next;
+    i32 offset = 0;
+    for (p_island_t &island : m_islands.islands) {
+        island.first = offset;
+        offset += island.count;
+        island.count = 0;
     }
+
+    m_islands.particles.resize(offset);
+    m_islands.rows.resize(offset);
+    for (i32 r = 0; r < num; ++r) {
+        if (!dynamic[r]) continue;
+
+        p_island_t &island = m_islands.islands[island_of[find(r)]];
+        m_islands.particles[island.first + island.count] = row_particle[r];
+        m_islands.rows[island.first + island.count] = r;
+        island.count++;
+    }
+
+    // Island sleeps if all its bodies sleep, a woken body wakes all others
+    body_t const *body = m_db.p_particles.column<pp_body>();
+    m_islands.row_asleep.assign(num, 0);
+
+    for (p_island_t &island : m_islands.islands) {
+        island.sleeping = !island.restless;
+        for (i32 k = island.first; k < island.first + island.count; ++k) {
+            island.sleeping = island.sleeping && m_db.p_bodies.get(body[m_islands.rows[k]].index)->sleeping;
+        }
+
+        if (island.sleeping) {
+            for (i32 k = island.first; k < island.first + island.count; ++k) {
+                m_islands.row_asleep[m_islands.rows[k]] = 1;
+            }
+        }
+        else {
+            wake_island(island);
+        }
+    }
+
+    count_awake();
+
+    m_islands.dirty = false;
 }
 
-void physics_t::make_move(body_t body)
+void physics_t::sleep_island(p_island_t &island)
 {
-    p_body_t *p_body = m_db.p_bodies.get(body.index);
-    NULL_WARNING(p_body);
-    if (p_body == nullptr) return;
+    vec3 *position_prev = m_db.p_particles.column<pp_position_prev>();
+    vec3 const *position_now = m_db.p_particles.column<pp_position_now>();
+    vec3 *position_next = m_db.p_particles.column<pp_position_next>();
+    vec3 *velocity_now = m_db.p_particles.column<pp_velocity_now>();
+    vec3 *velocity_next = m_db.p_particles.column<pp_velocity_next>();
+    body_t const *body = m_db.p_particles.column<pp_body>();
 
-    for (particle_t const &particle : p_body->particles) {
-        p_particle_t *p = m_db.p_particles.get(particle.index);
+    island.sleeping = true;
 
-        p->position.prev = p->position.now;
-        p->position.now = p->position.next;
+    for (i32 k = island.first; k < island.first + island.count; ++k) {
+        m_db.p_bodies.get(body[m_islands.rows[k]].index)->sleeping = true;
+    }
+
+    // At rest, wakes up without velocity
+    for (i32 k = island.first; k < island.first + island.count; ++k) {
+        i32 r = m_islands.rows[k];
+        position_prev[r] = position_now[r];
+        position_next[r] = position_now[r];
+        velocity_now[r] = vec3 {0.0f, 0.0f, 0.0f};
+        velocity_next[r] = vec3 {0.0f, 0.0f, 0.0f};
+        m_islands.row_asleep[r] = 1;
+        update_particle_state(m_islands.particles[k]);
+    }
+
+    m_colors.dirty = true;
+    m_jacobi.dirty = true;
+}
+
+void physics_t::wake_island(p_island_t &island)
+{
+    body_t const *body = m_db.p_particles.column<pp_body>();
 
-        p->velocity.prev = p->velocity.now;
-        p->velocity.now = p->velocity.next;
+    island.sleeping = false;
+    island.still_steps = 0;
 
-        p->acceleration.prev = p->acceleration.now;
-        p->acceleration.now = p->acceleration.next;
+    bool was_asleep = false;
+    for (i32 k = island.first; k < island.first + island.count; ++k) {
+        p_body_t *p_body = m_db.p_bodies.get(body[m_islands.rows[k]].index);
+        was_asleep = was_asleep || p_body->sleeping || m_islands.row_asleep[m_islands.rows[k]];
+        p_body->sleeping = false;
     }
+    if (!was_asleep) return;
+
+    for (i32 k = island.first; k < island.first + island.count; ++k) {
+        m_islands.row_asleep[m_islands.rows[k]] = 0;
+        update_particle_state(m_islands.particles[k]);
+    }
+
+    m_colors.dirty = true;
+    m_jacobi.dirty = true;
+}
+
+void physics_t::count_awake()
+{
+    i32 num = m_db.p_particles.size();
+    f32 const *inv_mass = m_db.p_particles.column<pp_inv_mass>();
+
+    m_islands.num_awake = 0;
+    for (i32 r = 0; r < num; ++r) {
+        m_islands.num_awake += (inv_mass[r] > 0.0f && m_islands.row_asleep[r] == 0) ? 1 : 0;
+    }
+
+    m_islands.row_island.assign(num, -1);
+    for (size_t n = 0; n < m_islands.islands.size(); ++n) {
+        p_island_t const &island = m_islands.islands[n];
+        for (i32 k = island.first; k < island.first + island.count; ++k) {
+            m_islands.row_island[m_islands.rows[k]] = static_cast<i32>(n);
+        }
+    }
+
+    // Runs of rows not asleep, cut and grouped to about a grain of rows per task
+    std::vector<i32> &spans = m_islands.awake_spans;
+    std::vector<i32> &chunks = m_islands.awake_chunks;
+    spans.clear();
+    chunks.assign(1, 0);
+
+    i32 num_spans = 0;
+    i32 chunk_rows = 0;
+    for (i32 r = 0; r < num;) {
+        if (m_islands.row_asleep[r]) {
+            ++r;
+            continue;
+        }
+
+        i32 end = r;
+        while (end < num && m_islands.row_asleep[end] == 0 && end - r < OGP_PHYSICS_GRAIN) ++end;
+        spans.push_back(r);
+        spans.push_back(end);
+        num_spans++;
+
+        chunk_rows += end - r;
+        if (chunk_rows >= OGP_PHYSICS_GRAIN) {
+            chunks.push_back(num_spans);
+            chunk_rows = 0;
+        }
+        r = end;
+    }
+    if (chunks.back() != num_spans) chunks.push_back(num_spans);
+}
+
+void physics_t::update_sleep(f32 dt)
+{
+    if (!m_sleeping) return;
+
+    vec3 const *position_prev = m_db.p_particles.column<pp_position_prev>();
+    vec3 const *position_now = m_db.p_particles.column<pp_position_now>();
+    f32 energy_scale = 0.5f / (dt * dt);
+
+    bool changed = false;
+    for (p_island_t &island : m_islands.islands) {
+        // Asleep rows do not move, collide_particles() wakes islands an awake one pushes
+        if (island.restless || island.sleeping) continue;
+
+        // Kinetic energy per mass of fastest particle over last step
+        f32 energy = 0.0f;
+        for (i32 k = island.first; k < island.first + island.count; ++k) {
+            i32 r = m_islands.rows[k];
+            vec3 d = position_now[r] - position_prev[r];
+            energy = std::max(energy, glm::dot(d, d) * energy_scale);
+        }
+
+        bool still = energy < m_sleep_energy;
+
+        island.still_steps = still ? island.still_steps + 1 : 0;
+        if (island.still_steps >= m_sleep_steps) {
+            sleep_island(island);
+            changed = true;
+        }
+    }
+
+    if (changed) count_awake();
+}
+
+void physics_t::set_sleeping(bool sleeping, f32 energy, i32 steps)
+{
+    m_sleep_energy = energy;
+    m_sleep_steps = steps;
+
+    if (m_sleeping == sleeping) return;
+    m_sleeping = sleeping;
+
+    // Islands are not kept up to date while off
+    if (!sleeping) {
+        for (p_body_t &p_body : m_db.p_bodies) {
+            p_body.sleeping = false;
+        }
+        for (particle_t particle : m_islands.particles) {
+            update_particle_state(particle);
+        }
+        m_islands.islands.clear();
+        m_islands.particles.clear();
+        m_islands.rows.clear();
+        m_islands.row_asleep.clear();
+        m_colors.dirty = true;
+        m_jacobi.dirty = true;
+    }
+
+    m_islands.dirty = true;
+}
+
+void physics_t::wake_body(body_t body)
+{
+    p_body_t *p_body = m_db.p_bodies.get(body.index);
+    if (p_body == nullptr || !p_body->sleeping) return;
+
+    // Rest of the island wakes when islands are rebuilt
+    p_body->sleeping = false;
+    for_each_body_particle(*p_body, [this](particle_t particle) {
+        update_particle_state(particle);
+    });
+    mark_constraints_dirty();
+}
+
+bool physics_t::body_sleeping(body_t body) const
+{
+    p_body_t const *p_body = m_db.p_bodies.get(body.index);
+    return p_body != nullptr && p_body->sleeping;
+}
+
+i32 physics_t::num_sleeping_islands() const
+{
+    i32 num = 0;
+    for (p_island_t const &island : m_islands.islands) {
+        num += island.sleeping ? 1 : 0;
+    }
+    return num;
+}
+
+void physics_t::update_particle_state(particle_t particle)
+{
+    f32 *integrate = m_db.p_particles.get<pp_integrate>(particle.index);
+    if (integrate == nullptr) return;
+
+    body_t body = *m_db.p_particles.get<pp_body>(particle.index);
+    p_body_t const *p_body = m_db.p_bodies.get(body.index);
+    body_type_e body_type = (p_body != nullptr) ? p_body->body_type : body_type_e::body_static;
+    bool asleep = (p_body != nullptr) && p_body->sleeping;
+    bool pinned = is_pinned(particle);
+
+    *integrate = (body_type == body_type_e::body_dynamic && !pinned && !asleep) ? 1.0f : 0.0f;
+
+    // Kinematic and sleeping particles are not integrated, but constraints
+    // and collisions still move them
+    f32 mass = *m_db.p_particles.get<pp_mass>(particle.index);
+    bool fixed = pinned || body_type == body_type_e::body_static;
+    *m_db.p_particles.get<pp_inv_mass>(particle.index) = fixed ? 0.0f : 1.0f / mass;
 }
 
 particle_t physics_t::create_particle(body_t body, vec3 position)
 {
+    mark_constraints_dirty();
+
     p_body_t *p_body = m_db.p_bodies.get(body.index);
     NULL_WARNING(p_body);
 
@@ -346,53 +1398,86 @@ particle_t physics_t::create_particle(body_t body, vec3 position)
 
     if (p_body == nullptr) return particle;
 
-    p_particle_t p_particle;
-    p_particle.position.prev = position;
-    p_particle.position.now = position;
-    p_particle.position.next = position;
-
-    particle.index = m_db.p_particles.add(p_particle);
-
-    p_body->particles.push_back(particle);
-    p_body->uniq_particles.insert(particle.index);
+    vec3 zero {0.0f, 0.0f, 0.0f};
+    f32 mass = 1.0f;
+    f32 radius = 0.01f;
+    f32 integrate = (p_body->body_type == body_type_e::body_dynamic) ? 1.0f : 0.0f;
+    f32 inv_mass = (p_body->body_type == body_type_e::body_static) ? 0.0f : 1.0f / mass;
+
+    particle.index = m_db.p_particles.add(position, position, position,
+                                          position,
+                                          zero, zero,
+                                          zero,
+                                          mass, radius, integrate,
+                                          inv_mass,
+                                          body,
+                                          zero,
+                                          particle_t {},
+                                          0);
+
+    // Appended to end of body particle list
+    if (p_body->num_particles == 0) {
+        p_body->first_particle = particle;
+    }
+    else {
+        *m_db.p_particles.get<pp_next_in_body>(p_body->last_particle.index) = particle;
+    }
+    p_body->last_particle = particle;
+    p_body->num_particles++;
 
     return particle;
 }
 
 void physics_t::destroy_particle(particle_t particle)
 {
+    mark_constraints_dirty();
+
+    body_t const *body = m_db.p_particles.get<pp_body>(particle.index);
+    if (body != nullptr) wake_body(*body);
+
     // FIXME destroy hell (look: destroy_body)
     // (1) DESTROY PARTICLE RELATED CONSTRAINTS ................................
 
-    std::vector<constraint_t> constraints_to_remove;
     for (p_constraint_t const &p_constraint : m_db.p_constraints) {
         bool test_a = (particle.index == p_constraint.A.particle.index);
         bool test_b = (particle.index == p_constraint.B.particle.index);
         if (test_a || test_b) {
-            constraints_to_remove.push_back(p_constraint.constraint);
+            m_db.p_constraints.mark_removed(p_constraint.constraint.index);
         }
     }
-    for (constraint_t const &constraint : constraints_to_remove) {
-        destroy_constraint(constraint);
-    }
+    m_db.p_constraints.compact();
 
     // (2) DESTROY BODY RELATED PINS ...........................................
 
-    std::vector<pin_t> pins_to_remove;
     for (p_pin_t const &p_pin : m_db.p_pins) {
         bool test_master = (particle.index == p_pin.master.particle.index);
         bool test_slave = (particle.index == p_pin.slave.particle.index);
         if (test_master || test_slave) {
-            pins_to_remove.push_back(p_pin.pin);
+            (*m_db.p_particles.get<pp_num_pins>(p_pin.slave.particle.index))--;
+            update_particle_state(p_pin.slave.particle);
+            m_db.p_pins.mark_removed(p_pin.pin.index);
         }
     }
-    for (pin_t const &pin : pins_to_remove) {
-        destroy_pin(pin);
+    m_db.p_pins.compact();
+
+    // (3) DESTROY PARTICLE RELATED SPRINGS ....................................
+
+    for (p_spring_t const &p_spring : m_db.p_springs) {
+        bool test_a = (particle.index == p_spring.A.particle.index);
+        bool test_b = (particle.index == p_spring.B.particle.index);
+        if (test_a || test_b) {
+            wake_body(p_spring.A.body);
+            wake_body(p_spring.B.body);
+            m_db.p_springs.mark_removed(p_spring.spring.index);
+        }
     }
+    m_db.p_springs.compact();
 }
 
 constraint_t physics_t::create_constraint(body_t body_A, particle_t particle_A, body_t body_B, particle_t particle_B)  // done
 {
+    mark_constraints_dirty();
+
     p_body_t *p_body_A = m_db.p_bodies.get(body_A.index);
     p_body_t *p_body_B = m_db.p_bodies.get(body_B.index);
 
@@ -402,8 +1487,8 @@ constraint_t physics_t::create_constraint(body_t body_A, particle_t particle_A,
     if (p_body_A == nullptr || p_body_B == nullptr) std::terminate();
 
     // TODO check in_A and in_B
-    bool in_A = p_body_A->uniq_particles.count(particle_A.index) == 1;
-    bool in_B = p_body_B->uniq_particles.count(particle_B.index) == 1;
+    bool in_A = body_has_particle(body_A, particle_A);
+    bool in_B = body_has_particle(body_B, particle_B);
     if (!in_A) {
         ogp_log_error("there is no such particle %d in body %d", particle_A.index.value, body_A.index.value);
         terminate("");
@@ -413,8 +1498,8 @@ constraint_t physics_t::create_constraint(body_t body_A, particle_t particle_A,
         terminate("");
     }
 
-    p_particle_t *p_particle_A = m_db.p_particles.get(particle_A.index);
-    p_particle_t *p_particle_B = m_db.p_particles.get(particle_B.index);
+    vec3 const *p_particle_A = m_db.p_particles.get<pp_position_now>(particle_A.index);
+    vec3 const *p_particle_B = m_db.p_particles.get<pp_position_now>(particle_B.index);
 
     NULL_WARNING(p_particle_A);
     NULL_WARNING(p_particle_B);
@@ -428,8 +1513,8 @@ constraint_t physics_t::create_constraint(body_t body_A, particle_t particle_A,
         return constraint;
     }
 
-    vec3 pos_A = p_particle_A->position.now;
-    vec3 pos_B = p_particle_B->position.now;
+    vec3 pos_A = *p_particle_A;
+    vec3 pos_B = *p_particle_B;
 
     p_constraint_t p_constraint {};
     p_constraint.A.particle = particle_A;
@@ -440,6 +1525,9 @@ constraint_t physics_t::create_constraint(body_t body_A, particle_t particle_A,
 
     constraint.index = m_db.p_constraints.add(p_constraint);
 
+    wake_body(body_A);
+    wake_body(body_B);
+
     // assign constraint index holder to its own definition (p_constraint)
     m_db.p_constraints.get(constraint.index)->constraint = constraint;
 
@@ -448,19 +1536,116 @@ constraint_t physics_t::create_constraint(body_t body_A, particle_t particle_A,
 
 void physics_t::destroy_constraint(constraint_t constraint)  // done
 {
+    mark_constraints_dirty();
+
+    p_constraint_t const *p_constraint = m_db.p_constraints.get(constraint.index);
+    if (p_constraint != nullptr) {
+        wake_body(p_constraint->A.body);
+        wake_body(p_constraint->B.body);
+    }
+
     m_db.p_constraints.remove_index(constraint.index);
 }
 
+spring_t physics_t::create_spring(body_t body_A, particle_t particle_A, body_t body_B, particle_t particle_B, f32 stiffness, f32 damping)
+{
+    p_body_t const *p_body_A = m_db.p_bodies.get(body_A.index);
+    p_body_t const *p_body_B = m_db.p_bodies.get(body_B.index);
+
+    NULL_WARNING(p_body_A);
+    NULL_WARNING(p_body_B);
+
+    if (p_body_A == nullptr || p_body_B == nullptr) std::terminate();
+
+    bool in_A = body_has_particle(body_A, particle_A);
+    bool in_B = body_has_particle(body_B, particle_B);
+    if (!in_A) {
+        ogp_log_error("there is no such particle %d in body %d", particle_A.index.value, body_A.index.value);
+        terminate("");
+    }
+    if (!in_B) {
+        ogp_log_error("there is no such particle %d in body %d", particle_B.index.value, body_B.index.value);
+        terminate("");
+    }
+
+    if (stiffness < 0.0f || damping < 0.0f) {
+        ogp_log_warning("Spring stiffness and damping should not be negative: %f, %f", stiffness, damping);
+    }
+
+    mark_constraints_dirty();
+
+    vec3 pos_A = *m_db.p_particles.get<pp_position_now>(particle_A.index);
+    vec3 pos_B = *m_db.p_particles.get<pp_position_now>(particle_B.index);
+
+    p_spring_t p_spring {};
+    p_spring.A.particle = particle_A;
+    p_spring.A.body = body_A;
+    p_spring.B.particle = particle_B;
+    p_spring.B.body = body_B;
+    p_spring.length = glm::distance(pos_A, pos_B);
+    p_spring.stiffness = std::max(0.0f, stiffness);
+    p_spring.damping = std::max(0.0f, damping);
+
+    spring_t spring {};
+    spring.index = m_db.p_springs.add(p_spring);
+
+    wake_body(body_A);
+    wake_body(body_B);
+
+    // assign spring index holder to its own definition (p_spring)
+    m_db.p_springs.get(spring.index)->spring = spring;
+
+    return spring;
+}
+
+void physics_t::destroy_spring(spring_t spring)
+{
+    mark_constraints_dirty();
+
+    p_spring_t const *p_spring = m_db.p_springs.get(spring.index);
+    if (p_spring != nullptr) {
+        wake_body(p_spring->A.body);
+        wake_body(p_spring->B.body);
+    }
+
+    m_db.p_springs.remove_index(spring.index);
+}
+
+bool physics_t::spring_exists(spring_t spring) const
+{
+    return m_db.p_springs.get(spring.index) != nullptr;
+}
+
+void physics_t::set_constraint_compliance(constraint_t constraint, f32 compliance)
+{
+    p_constraint_t *p_constraint = m_db.p_constraints.get(constraint.index);
+    NULL_WARNING(p_constraint);
+    if (p_constraint == nullptr) return;
+
+    mark_constraints_dirty();
+    wake_body(p_constraint->A.body);
+    wake_body(p_constraint->B.body);
+
+    p_constraint->compliance = std::max(0.0f, compliance);
+}
+
 pin_t physics_t::create_pin(body_t body_master, particle_t master, body_t body_slave, particle_t slave)
 {
+    mark_constraints_dirty();
+
     p_pin_t p_pin {};
     p_pin.master.body = body_master;
     p_pin.master.particle = master;
     p_pin.slave.body = body_slave;
     p_pin.slave.particle = slave;
 
-    // FIXME
-    m_pinned_particles.insert(slave.index);
+    i32 *num_pins = m_db.p_particles.get<pp_num_pins>(slave.index);
+    NULL_WARNING(num_pins);
+    if (num_pins == nullptr) return pin_t {};
+
+    (*num_pins)++;
+    wake_body(body_slave);
+    update_particle_state(slave);
 
     pin_t pin {};
     pin.index = m_db.p_pins.add(p_pin);
@@ -473,25 +1658,285 @@ pin_t physics_t::create_pin(body_t body_master, particle_t master, body_t body_s
 
 void physics_t::destroy_pin(pin_t pin)
 {
+    mark_constraints_dirty();
+
+    p_pin_t const *p_pin = m_db.p_pins.get(pin.index);
+    if (p_pin != nullptr) {
+        particle_t slave = p_pin->slave.particle;
+        (*m_db.p_particles.get<pp_num_pins>(slave.index))--;
+        wake_body(p_pin->slave.body);
+        update_particle_state(slave);
+    }
+
     m_db.p_pins.remove_index(pin.index);
 }
 
-bool physics_t::is_pinned(particle_t particle)
+bool physics_t::is_pinned(particle_t particle) const
+{
+    i32 const *num_pins = m_db.p_particles.get<pp_num_pins>(particle.index);
+    return num_pins != nullptr && *num_pins > 0;
+}
+
+bool physics_t::body_has_particle(body_t body, particle_t particle) const
+{
+    body_t const *owner = m_db.p_particles.get<pp_body>(particle.index);
+    return owner != nullptr && *owner == body;
+}
+
+collider_t physics_t::add_collider(p_collider_t &p_collider)
+{
+    m_shapes.dirty = true;
+
+    collider_t collider {};
+    collider.index = m_db.p_colliders.add(p_collider);
+
+    p_collider_t *added = m_db.p_colliders.get(collider.index);
+    NULL_WARNING(added);
+    if (added != nullptr) added->collider = collider;
+
+    return collider;
+}
+
+collider_t physics_t::create_plane(vec3 normal, f32 offset)
+{
+    p_collider_t p_collider {};
+    p_collider.type = collider_type_e::plane;
+    p_collider.plane.normal = glm::normalize(normal);
+    p_collider.plane.offset = offset;
+
+    return add_collider(p_collider);
+}
+
+collider_t physics_t::create_sphere(vec3 center, f32 radius)
+{
+    p_collider_t p_collider {};
+    p_collider.type = collider_type_e::sphere;
+    p_collider.sphere.center = center;
+    p_collider.sphere.radius = radius;
+
+    return add_collider(p_collider);
+}
+
+collider_t physics_t::create_capsule(vec3 a, vec3 b, f32 radius)
+{
+    p_collider_t p_collider {};
+    p_collider.type = collider_type_e::capsule;
+    p_collider.capsule.a = a;
+    p_collider.capsule.b = b;
+    p_collider.capsule.radius = radius;
+
+    return add_collider(p_collider);
+}
+
+collider_t physics_t::create_box(vec3 center, quat orientation, vec3 half_extents)
+{
+    p_collider_t p_collider {};
+    p_collider.type = collider_type_e::box;
+    p_collider.box.center = center;
+    p_collider.box.axes = glm::mat3_cast(glm::normalize(orientation));
+    p_collider.box.half_extents = half_extents;
+
+    return add_collider(p_collider);
+}
+
+collider_t physics_t::create_triangle_mesh(std::vector<vec3> const &vertices)
+{
+    bvh_t bvh;
+    bvh.build(vertices.data(), static_cast<i32>(vertices.size() / 3));
+
+    p_collider_t p_collider {};
+    p_collider.type = collider_type_e::mesh;
+    p_collider.mesh = m_db.p_meshes.add(bvh);
+
+    return add_collider(p_collider);
+}
+
+void physics_t::destroy_collider(collider_t collider)
+{
+    m_shapes.dirty = true;
+
+    p_collider_t const *p_collider = m_db.p_colliders.get(collider.index);
+    if (p_collider != nullptr && p_collider->type == collider_type_e::mesh) {
+        m_db.p_meshes.remove_index(p_collider->mesh);
+    }
+
+    m_db.p_colliders.remove_index(collider.index);
+}
+
+bool physics_t::raycast(vec3 origin, vec3 direction, f32 max_t, ray_hit_t *hit, collider_t *collider) const
+{
+    bool found = false;
+    ray_hit_t closest {};
+    closest.t = max_t;
+
+    for (p_collider_t const &p_collider : m_db.p_colliders) {
+        if (p_collider.type != collider_type_e::mesh) continue;
+
+        ray_hit_t mesh_hit {};
+        bvh_t const *bvh = m_db.p_meshes.get(p_collider.mesh);
+        if (bvh->raycast(origin, direction, closest.t, &mesh_hit)) {
+            closest = mesh_hit;
+            found = true;
+            if (collider != nullptr) *collider = p_collider.collider;
+        }
+    }
+
+    if (found && hit != nullptr) *hit = closest;
+    return found;
+}
+
+bool physics_t::collider_exists(collider_t collider) const
+{
+    return m_db.p_colliders.get(collider.index) != nullptr;
+}
+
+/// Counts of island arrays in snapshot, blocks of them follow.
+struct p_islands_header_t
+{
+    i32 num_islands;
+    i32 num_particles;
+    i32 num_rows;
+    i32 num_row_asleep;
+    i32 num_awake;
+    i32 dirty;
+};
+
+template <typename T>
+static void append_block(std::vector<u8> &buffer, T const *src, i32 num)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshot needs trivially copyable T");
+
+    size_t begin = buffer.size();
+    buffer.resize(begin + num * sizeof(T));
+    if (num > 0) std::memcpy(buffer.data() + begin, src, num * sizeof(T));
+}
+
+template <typename T>
+static void read_block(std::vector<T> *dst, std::vector<u8> const &buffer, size_t &offset, i32 num)
+{
+    dst->resize(num);
+    if (num > 0) std::memcpy(dst->data(), buffer.data() + offset, num * sizeof(T));
+    offset += num * sizeof(T);
+}
+
+void physics_t::set_num_snapshots(i32 num)
+{
+    if (num < 1) {
+        ogp_log_error("Number of snapshots should be positive: %d", num);
+        return;
+    }
+
+    m_snapshots.clear();
+    m_snapshots.resize(num);
+}
+
+i64 physics_t::save_snapshot()
+{
+    p_snapshot_t &snapshot = m_snapshots[m_frame % static_cast<i64>(m_snapshots.size())];
+    snapshot.frame = m_frame;
+
+    std::vector<u8> &buffer = snapshot.buffer;
+    buffer.clear();
+
+    m_db.p_particles.save(buffer);
+    m_db.p_bodies.save(buffer);
+    m_db.p_constraints.save(buffer);
+    m_db.p_springs.save(buffer);
+    m_db.p_pins.save(buffer);
+    m_user_db.dynamic_bodies.save(buffer);
+    m_user_db.kinematic_bodies.save(buffer);
+    m_user_db.static_bodies.save(buffer);
+
+    // Islands keep still steps counters, replay sleeps at the same frame
+    p_islands_header_t header {};
+    header.num_islands = static_cast<i32>(m_islands.islands.size());
+    header.num_particles = static_cast<i32>(m_islands.particles.size());
+    header.num_rows = static_cast<i32>(m_islands.rows.size());
+    header.num_row_asleep = static_cast<i32>(m_islands.row_asleep.size());
+    header.num_awake = m_islands.num_awake;
+    header.dirty = m_islands.dirty ? 1 : 0;
+
+    append_block(buffer, &header, 1);
+    append_block(buffer, m_islands.islands.data(), header.num_islands);
+    append_block(buffer, m_islands.particles.data(), header.num_particles);
+    append_block(buffer, m_islands.rows.data(), header.num_rows);
+    append_block(buffer, m_islands.row_asleep.data(), header.num_row_asleep);
+
+    return m_frame;
+}
+
+physics_t::p_snapshot_t const *physics_t::find_snapshot(i64 frame) const
+{
+    if (frame < 0) return nullptr;
+
+    p_snapshot_t const &snapshot = m_snapshots[frame % static_cast<i64>(m_snapshots.size())];
+    return (snapshot.frame == frame) ? &snapshot : nullptr;
+}
+
+size_t physics_t::snapshot_size(i64 frame) const
+{
+    p_snapshot_t const *snapshot = find_snapshot(frame);
+    return (snapshot == nullptr) ? 0 : snapshot->buffer.size();
+}
+
+bool physics_t::restore_snapshot(i64 frame)
 {
-    return m_pinned_particles.count(particle.index) == 1;
+    p_snapshot_t const *snapshot = find_snapshot(frame);
+    if (snapshot == nullptr) {
+        ogp_log_warning("There is no snapshot of frame %lld", (long long) frame);
+        return false;
+    }
+
+    std::vector<u8> const &buffer = snapshot->buffer;
+    size_t offset = 0;
+
+    bool restored = m_db.p_particles.restore(buffer, offset)
+                 && m_db.p_bodies.restore(buffer, offset)
+                 && m_db.p_constraints.restore(buffer, offset)
+                 && m_db.p_springs.restore(buffer, offset)
+                 && m_db.p_pins.restore(buffer, offset)
+                 && m_user_db.dynamic_bodies.restore(buffer, offset)
+                 && m_user_db.kinematic_bodies.restore(buffer, offset)
+                 && m_user_db.static_bodies.restore(buffer, offset);
+
+    // Written by save_snapshot() only, world is half restored now
+    if (!restored) terminate("broken physics snapshot");
+
+    p_islands_header_t header {};
+    std::memcpy(&header, buffer.data() + offset, sizeof(header));
+    offset += sizeof(header);
+
+    read_block(&m_islands.islands, buffer, offset, header.num_islands);
+    read_block(&m_islands.particles, buffer, offset, header.num_particles);
+    read_block(&m_islands.rows, buffer, offset, header.num_rows);
+    read_block(&m_islands.row_asleep, buffer, offset, header.num_row_asleep);
+    m_islands.num_awake = header.num_awake;
+    m_islands.dirty = header.dirty != 0;
+    if (!m_islands.dirty) count_awake();
+
+    // Prepared constraints are rebuilt from restored pools
+    m_colors.dirty = true;
+    m_jacobi.dirty = true;
+    m_springs.dirty = true;
+
+    // Later frames belong to the abandoned timeline
+    for (p_snapshot_t &s : m_snapshots) {
+        if (s.frame > frame) s.frame = -1;
+    }
+
+    m_frame = frame;
+    return true;
 }
 
-void physics_t::debug_draw(render_context_t *rc, f32 frame_dt)
+void physics_t::debug_draw(render_recorder_t *rc, f32 frame_dt)
 {
     // DRAW PARTICLES ..........................................................
 
     rc->set_line_color(230, 230, 230);
-    for (p_particle_t const &p_particle : m_db.p_particles) {
-        vec3 pos_now = p_particle.position.now;
-        vec3 pos_next = p_particle.position.next;
+    m_db.p_particles.for_each<pp_position_now, pp_position_next>([rc, frame_dt](vec3 const &pos_now, vec3 const &pos_next) {
         vec3 pos = pos_now + (pos_next - pos_now) * frame_dt;
         rc->draw_point(pos);
-    }
+    });
 
     // DRAW CONSTRAINTS ........................................................
 
@@ -502,15 +1947,40 @@ void physics_t::debug_draw(render_context_t *rc, f32 frame_dt)
 
         rc->draw_line(pos_A, pos_B);
     }
+
+    // DRAW SPRINGS ............................................................
+
+    rc->set_line_color(102, 178, 255);
+    for (p_spring_t const &p_spring : m_db.p_springs) {
+        vec3 pos_A = get_particle_pos(p_spring.A.particle, frame_dt);
+        vec3 pos_B = get_particle_pos(p_spring.B.particle, frame_dt);
+
+        rc->draw_line(pos_A, pos_B);
+    }
 }
 
 void physics_t::debug_print_stats() const
 {
     ogp_log_info("physics_t stats :");
-    ogp_log_info("    particles   : %d", m_db.p_particles.size());
-    ogp_log_info("    bodies      : %d", m_db.p_bodies.size());
-    ogp_log_info("    constraints : %d", m_db.p_constraints.size());
-    ogp_log_info("    pins        : %d", m_db.p_pins.size());
+
+    solver_stats_t const &st = m_solver_stats;
+    f32 mean_iterations = (st.num_steps == 0) ? 0.0f : static_cast<f32>(st.num_iterations) / st.num_steps;
+    ogp_log_info("    %-12s: %7d / %7d iterations, mean = %.2f, early exits = %llu / %llu, substeps = %d",
+                 "solver", st.iterations, m_solver_max_iterations, mean_iterations,
+                 (unsigned long long) st.num_early_exits, (unsigned long long) st.num_steps, m_substeps);
+    ogp_log_info("    %-12s: max = %f, rms = %f, tolerance = %f", "residual", st.residual_max, st.residual_rms, m_solver_tolerance);
+    ogp_log_info("    %-12s: %7d / %7d sleeping, awake particles = %d", "islands", num_sleeping_islands(), num_islands(), m_islands.num_awake);
+    ogp_log_info("    %-12s: %016llx", "state hash", (unsigned long long) state_hash());
+
+    m_db.p_particles.print_stats("particles");
+    m_db.p_bodies.print_stats("bodies");
+    m_db.p_constraints.print_stats("constraints");
+    m_db.p_pins.print_stats("pins");
+    m_db.p_springs.print_stats("springs");
+    m_db.p_colliders.print_stats("colliders");
+    m_user_db.dynamic_bodies.print_stats("dynamic");
+    m_user_db.kinematic_bodies.print_stats("kinematic");
+    m_user_db.static_bodies.print_stats("static");
 }
 
 
@@ -678,41 +2148,6 @@ static void physics2d_satisfy_constraints(physics_spring_t *physics, p_constrain
 
 }
 
-static void physics2d_satisfy_springs(physics_spring_t *physics, p_spring_t *p_spring, i32 num)
-{
-    for (i32 i = 0; i < num; ++i) {
-        index_t pa_id = p_spring->a.particle;
-        index_t pb_id = p_spring->b.particle;
-        f32 init_length = p_spring->length;
-        f32 k = p_spring->springness;
-
-        p_particle2d_t *p_particle_a = physics->db.particles.get(pa_id);
-        p_particle2d_t *p_particle_b = physics->db.particles.get(pb_id);
-
-        vec2 pa_pos = p_particle_a->position.next;
-        vec2 pb_pos = p_particle_b->position.next;
-
-        vec2 delta = pb_pos - pa_pos;
-        f32 diff = vec2_length(delta);
-
-        f32 d = (diff - init_length) / diff;
-
-        glm::normalize(delta);
-
-        vec2 x = delta * d;
-
-        vec2 spring_force = -k * x;
-
-        // FIXME damping
-
-        p_particle_a->force += -spring_force;
-        p_particle_b->force +=  spring_force;
-
-        p_spring = p_spring + 1;
-    }
-
-}
-
 */
 
 }  // namespace ogp
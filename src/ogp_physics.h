@@ -2,19 +2,27 @@
 #define OGP_PHYSICS_H
 
 #include "ogp_array.h"
+#include "ogp_array_soa.h"
 #include "ogp_defines.h"
+#include "ogp_physics_broadphase.h"
+#include "ogp_physics_bvh.h"
+#include "ogp_physics_kernels.h"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 namespace ogp
 {
 
-class render_context_t;
+class render_recorder_t;
 
 struct body_t : public index_holder_t<body_t> { };
 struct particle_t : public index_holder_t<particle_t> { };
 struct constraint_t : public index_holder_t<constraint_t> { };
 struct pin_t : public index_holder_t<pin_t> { };
+struct collider_t : public index_holder_t<collider_t> { };
+struct spring_t : public index_holder_t<spring_t> { };
 
 enum class body_type_e : i32
 {
@@ -23,44 +31,52 @@ enum class body_type_e : i32
     body_static,
 };
 
-struct p_particle_t
+/** Particle columns of physics_t particle pool (array_soa_t).
+ *  Integration streams position, velocity, force, mass and integrate
+ *  columns only, see verlet_integrate().
+ */
+enum p_particle_e : size_t
 {
-    f32 mass {1.0f};
-    f32 radius {0.01f};
-    struct
-    {
-        vec3 prev {0.0f, 0.0f, 0.0f};
-        vec3 now {0.0f, 0.0f, 0.0f};
-        vec3 next {0.0f, 0.0f, 0.0f};
-    } position;
-    struct
-    {
-        vec3 prev {0.0f, 0.0f, 0.0f};
-        vec3 now {0.0f, 0.0f, 0.0f};
-        vec3 next {0.0f, 0.0f, 0.0f};
-    } velocity;
-    struct
-    {
-        vec3 prev {0.0f, 0.0f, 0.0f};
-        vec3 now {0.0f, 0.0f, 0.0f};
-        vec3 next {0.0f, 0.0f, 0.0f};
-    } acceleration;
-    vec3 force {0.0f, 0.0f, 0.0f};
-
-    struct
-    {
-        std::vector<vec3> position_next;
-    } calculations;
+    pp_position_prev = 0,
+    pp_position_now,
+    pp_position_next,
+    pp_position_rest,  // position at creation, cloth self-collision skips neighbours close at rest
+    pp_velocity_now,
+    pp_velocity_next,
+    pp_force,
+    pp_mass,
+    pp_radius,
+    pp_integrate,  // 1.0 if moved by integration (dynamic body, not pinned), 0.0 otherwise
+    pp_inv_mass,   // constraint weight, 1 / mass, 0.0 for pinned and static particles
+    pp_body,
+    pp_correction_sum,  // Jacobi, sum of collision pushes of one pass
+    pp_next_in_body,    // next particle of the same body, in creation order
+    pp_num_pins,        // pins holding particle as slave
 };
 
-// using p_particles_t = std::vector<p_particle_t>;
-using particles_t = std::vector<particle_t>;
-
+using p_particles_t = array_soa_t<OGP_PHYSICS_NUM_PARTICLES,
+                                  vec3, vec3, vec3,  // position prev, now, next
+                                  vec3,              // position rest
+                                  vec3, vec3,        // velocity now, next
+                                  vec3,              // force
+                                  f32, f32, f32,     // mass, radius, integrate
+                                  f32,               // inverse mass
+                                  body_t,
+                                  vec3,              // correction sum
+                                  particle_t,        // next in body
+                                  i32>;              // number of pins
+
+/** Body is flat, so pools of bodies copy with memcpy (snapshots). Its
+ *  particles are linked through pp_next_in_body, particle belongs to the
+ *  body in its pp_body.
+ */
 struct p_body_t
 {
     body_type_e body_type {body_type_e::body_dynamic};
-    particles_t particles;
-    unique_indices_t uniq_particles;
+    particle_t first_particle;
+    particle_t last_particle;
+    i32 num_particles {0};
+    bool sleeping {false};  // whole island sleeps, see physics_t::build_islands()
 };
 
 struct p_constraint_t
@@ -77,7 +93,28 @@ struct p_constraint_t
         particle_t particle;
     } B;
 
-    f32 length;  // initial length
+    f32 length;            // initial length
+    f32 compliance {0.0f};  // inverse stiffness, XPBD solver only, 0.0 is rigid
+};
+
+/// Damped spring, force along the line of its particles.
+struct p_spring_t
+{
+    spring_t spring;
+
+    struct {
+        body_t body;
+        particle_t particle;
+    } A;
+
+    struct {
+        body_t body;
+        particle_t particle;
+    } B;
+
+    f32 length;     // rest length, initial length
+    f32 stiffness;  // force per unit of stretch
+    f32 damping;    // force per unit of stretching speed
 };
 
 struct p_pin_t
@@ -95,43 +132,417 @@ struct p_pin_t
     } slave;
 };
 
+enum class collider_type_e : i32
+{
+    plane = 0,
+    sphere,
+    capsule,
+    box,
+    mesh,
+};
+
+/// Static analytic shape particles cannot enter, only shape of 'type' is used.
+struct p_collider_t
+{
+    collider_t collider;
+    collider_type_e type;
+
+    plane_shape_t plane;
+    sphere_shape_t sphere;
+    capsule_shape_t capsule;
+    box_shape_t box;
+    index_t mesh;  // BVH in mesh pool
+};
+
+/// Position based constraint solver of physics_t.
+enum class solver_e : i32
+{
+    jacobi = 0,            // every constraint from the same positions, corrections averaged
+    gauss_seidel_colored,  // constraints projected one after another, colors in parallel
+    xpbd,                  // colored, with compliance and Lagrange multipliers, stiffness independent of passes
+};
+
+/** Relative constraint length error, |length - rest| / rest, gathered over
+ *  one solver pass. Constraints with both particles fixed are left out.
+ */
+struct p_residual_t
+{
+    f32 max {0.0f};
+    f32 sum_sq {0.0f};
+    i32 count {0};
+
+    void add(f32 error)
+    {
+        error = std::abs(error);
+        max = std::max(max, error);
+        sum_sq += error * error;
+        count++;
+    }
+
+    void merge(p_residual_t const &other)
+    {
+        max = std::max(max, other.max);
+        sum_sq += other.sum_sq;
+        count += other.count;
+    }
+
+    f32 rms() const
+    {
+        return (count == 0) ? 0.0f : std::sqrt(sum_sq / count);
+    }
+};
+
+/// Dynamic bodies joined by constraints or pins, they sleep and wake together.
+struct p_island_t
+{
+    i32 first;              // particles [first, first + count) of island list
+    i32 count;
+    i32 still_steps {0};    // steps in a row below sleep energy
+    bool sleeping {false};
+    bool restless {false};  // tied to kinematic body, never sleeps
+};
+
+/// Solver work of last step and totals since start.
+struct solver_stats_t
+{
+    i32 iterations {0};        // passes run in last step
+    f32 residual_max {0.0f};   // of last pass, measured at its start
+    f32 residual_rms {0.0f};
+    u64 num_steps {0};
+    u64 num_iterations {0};
+    u64 num_early_exits {0};   // steps which converged before max iterations
+};
+
+/// Constraint prepared for parallel solvers, particles by data index.
+struct p_solver_constraint_t
+{
+    i32 a;
+    i32 b;
+    f32 length;
+    f32 coeff_a;
+    f32 coeff_b;
+    f32 inv_mass;    // sum of both inverse masses
+    f32 compliance;
+};
+
+/// Spring prepared for force pass, particles by data index.
+struct p_solver_spring_t
+{
+    i32 a;
+    i32 b;
+    f32 length;
+    f32 stiffness;
+    f32 damping;
+};
+
 class physics_t
 {
     vec3 m_gravity {0.0f, -9.81f, 0.0f};
 
+    solver_e m_solver {solver_e::jacobi};
+    i32 m_solver_max_iterations {1};
+    f32 m_solver_tolerance {0.0f};
+    solver_stats_t m_solver_stats;
+
+    i32 m_substeps {1};
+    std::vector<vec3> m_step_forces;  // external forces, held over substeps of one step
+
+    /** Constraints grouped by color, no two constraints of one color share
+     *  a particle. Built on demand, any change of bodies, particles,
+     *  constraints or pins makes it dirty.
+     */
+    struct {
+        std::vector<p_solver_constraint_t> constraints;
+        std::vector<i32> offsets;  // color c is [offsets[c], offsets[c + 1])
+        i32 num_serial {0};        // constraints out of colors, at the end, solved serially
+        std::vector<i32> chunk_base;          // first residual slot of color c
+        std::vector<p_residual_t> residuals;  // one per parallel chunk, serial ones last
+        std::vector<f32> lambdas;             // XPBD multipliers, one per constraint, zero at start of substep
+        bool dirty {true};
+    } m_colors;
+
+    /** Constraints in pool order for parallel Jacobi. A pass computes
+     *  corrections of all constraints at once, then every particle sums its
+     *  own ones in constraint order. No two threads write one particle and
+     *  sums do not depend on number of threads. Built on demand like m_colors.
+     */
+    struct {
+        std::vector<p_solver_constraint_t> constraints;
+        std::vector<vec3> corrections;        // 2 per constraint, for particle a and b
+        std::vector<i32> offsets;             // particle row r sums refs [offsets[r], offsets[r + 1])
+        std::vector<i32> refs;                // into corrections, ascending
+        std::vector<p_residual_t> residuals;  // one per parallel chunk
+        bool dirty {true};
+    } m_jacobi;
+
+    /** Springs in pool order for force pass, summed per particle the same
+     *  way as Jacobi corrections. Built on demand like m_colors.
+     */
+    struct {
+        std::vector<p_solver_spring_t> springs;
+        std::vector<vec3> forces;  // 2 per spring, on particle a and b
+        std::vector<i32> offsets;  // particle row r sums refs [offsets[r], offsets[r + 1])
+        std::vector<i32> refs;     // into forces, ascending
+        bool dirty {true};
+    } m_springs;
+
     struct {
-        array_t<p_particle_t, OGP_PHYSICS_NUM_PARTICLES> p_particles;
+        p_particles_t p_particles;
         array_t<p_body_t,OGP_PHYSICS_NUM_BODIES> p_bodies;
         array_t<p_constraint_t, OGP_PHYSICS_NUM_CONSTRAINTS> p_constraints;
         array_t<p_pin_t, OGP_PHYSICS_NUM_PINS> p_pins;
+        array_t<p_spring_t, OGP_PHYSICS_NUM_SPRINGS> p_springs;
+        array_t<p_collider_t, OGP_PHYSICS_NUM_COLLIDERS> p_colliders;
+        array_t<bvh_t, OGP_PHYSICS_NUM_MESHES> p_meshes;
     } m_db;
 
+    /// Colliders split by type into dense arrays, rebuilt when colliders change.
+    struct {
+        std::vector<plane_shape_t> planes;
+        std::vector<sphere_shape_t> spheres;
+        std::vector<capsule_shape_t> capsules;
+        std::vector<box_shape_t> boxes;
+        std::vector<bvh_t const *> meshes;
+        bool dirty {false};
+    } m_shapes;
+
     struct {
         array_t<body_t, OGP_PHYSICS_NUM_USER_BODIES> dynamic_bodies;
         array_t<body_t, OGP_PHYSICS_NUM_USER_BODIES> kinematic_bodies;
         array_t<body_t, OGP_PHYSICS_NUM_USER_BODIES> static_bodies;
     } m_user_db;
 
-    unique_indices_t m_pinned_particles;
+    bool m_collisions {true};
+    spatial_hash_t m_broadphase;
+
+    mutable std::vector<u64> m_hash_chunks;  // state_hash(), one per parallel chunk
+
+    i64 m_frame {0};  // steps done
+
+    /// World state of one frame, pools saved one after another.
+    struct p_snapshot_t
+    {
+        i64 frame {-1};
+        std::vector<u8> buffer;  // keeps its capacity, saving again does not allocate
+    };
+
+    std::vector<p_snapshot_t> m_snapshots;  // ring buffer, frame f lives in slot f % size
+
+    /// Snapshot of frame or nullptr if it is no longer kept.
+    p_snapshot_t const *find_snapshot(i64 frame) const;
+
+    bool m_sleeping {true};
+    f32 m_sleep_energy {OGP_PHYSICS_SLEEP_ENERGY};
+    i32 m_sleep_steps {OGP_PHYSICS_SLEEP_STEPS};
+
+    /** Islands over particle rows, built on demand like m_colors. Sleep
+     *  state itself lives in bodies and survives rebuilds.
+     */
+    struct {
+        std::vector<p_island_t> islands;
+        std::vector<particle_t> particles;  // grouped by island
+        std::vector<i32> rows;              // data rows of particles
+        std::vector<u8> row_asleep;         // 1 for rows of sleeping islands
+        std::vector<i32> row_island;        // island of each row, -1 for rows in none
+        std::vector<u8> row_touched;        // awake rows touching asleep ones this substep
+        std::vector<i32> awake_spans;       // [begin, end) pairs of rows not asleep
+        std::vector<i32> awake_chunks;      // spans [chunks[c], chunks[c + 1]) run as one task
+        i32 num_awake {0};                  // movable particles not asleep
+        bool dirty {true};
+    } m_islands;
 
     void satisfy_pins();
 
-    void satisfy_constraint(constraint_t constraint);
+    /// Call fn(particle) for particles of body in creation order, fn may remove the particle.
+    template <typename F>
+    void for_each_body_particle(p_body_t const &p_body, F fn) const
+    {
+        particle_t particle = p_body.first_particle;
+        for (i32 k = 0; k < p_body.num_particles; ++k) {
+            particle_t next = *m_db.p_particles.get<pp_next_in_body>(particle.index);
+            fn(particle);
+            particle = next;
+        }
+    }
+
+    /// True if particle exists and belongs to body.
+    bool body_has_particle(body_t body, particle_t particle) const;
+
+    /// Caches of prepared constraints and islands are rebuilt before next step.
+    void mark_constraints_dirty()
+    {
+        m_colors.dirty = true;
+        m_jacobi.dirty = true;
+        m_springs.dirty = true;
+        m_islands.dirty = true;
+    }
+
+    /// Constraints with no awake movable end are left out of solver passes.
+    bool constraint_asleep(p_solver_constraint_t const &c) const;
+
+    /** Union dynamic bodies over constraints, springs and pins into islands. Island
+     *  sleeps only if all its bodies sleep, otherwise all of them wake.
+     */
+    void build_islands();
+
+    /// Sleep still islands and wake moved ones, from last step displacement.
+    void update_sleep(f32 dt);
+
+    void sleep_island(p_island_t &island);
+
+    void wake_island(p_island_t &island);
+
+    /// Recount movable particles which are not asleep, spans of their rows and island of each row.
+    void count_awake();
+
+    /** Call fn(begin, end) over rows which are not asleep, chunks in parallel.
+     *  All rows while islands are not built.
+     */
+    template <typename F>
+    void parallel_for_awake(F const &fn);
+
+    void prepare_springs();
+
+    /** Add forces of all springs to their particles, from positions and
+     *  velocities at start of step.
+     */
+    void satisfy_springs(f32 dt);
+
+    /// Global solver loop, passes until residual is within tolerance or max iterations.
+    void satisfy_constraints(f32 dt);
+
+    void prepare_jacobi();
+
+    p_residual_t satisfy_constraints_jacobi();
 
-    void satisfy_constraints();
+    /// Split constraint correction between particles by their inverse mass.
+    void constraint_coeffs(p_constraint_t const &p_constraint, f32 *coeff_a, f32 *coeff_b) const;
 
-    void solve_verlet(body_t body, f32 dt);
+    p_solver_constraint_t prepare_constraint(p_constraint_t const &p_constraint) const;
 
-    void make_move(body_t body);
+    void color_constraints();
+
+    /// Call project(begin, end, residual) over colors one after another, chunks of a color in parallel.
+    template <typename F>
+    p_residual_t project_colored(F const &project);
+
+    p_residual_t satisfy_constraints_colored();
+
+    /// One XPBD pass, multipliers carry over passes of one substep.
+    p_residual_t satisfy_constraints_xpbd(f32 dt);
+
+    /** Push apart particles closer than sum of their radii, including particles
+     *  of one body. Pairs of one body which are that close at rest are skipped.
+     *  Asleep particles hold still, an awake one touching them wakes their island.
+     */
+    void collide_particles();
+
+    /** Push particles out of colliders, batched by shape type. Particles
+     *  moving more than their radius in this step are swept from now to next
+     *  position first, so they do not pass through thin colliders.
+     */
+    void collide_shapes();
+
+    collider_t add_collider(p_collider_t &p_collider);
+
+    /// Integrate particles not asleep at once, straight from particle columns.
+    void solve_verlet(f32 dt);
+
+    /// Shift next state to now and now to prev for particles not asleep.
+    void make_move();
+
+    /** Put particle and constraint rows back in creation order after many
+     *  removals. Rows move only here, at start of step, and caches over
+     *  rows are rebuilt.
+     */
+    void defragment_rows();
+
+    /// Whole pipeline over 'dt', step() runs it once per substep.
+    void substep(f32 dt);
+
+    /// Recompute integrate and inverse mass columns of particle from its body type, pins and mass.
+    void update_particle_state(particle_t particle);
 
 public:
 
-    physics_t() = default;
+    physics_t();
 
     physics_t(physics_t const &physics) = delete;
 
     void step(f32 dt);
 
+    /** Select constraint solver, most passes per step and max relative length
+     *  error at which a step stops early. Zero tolerance runs all passes.
+     */
+    void set_solver(solver_e solver, i32 max_iterations = 1, f32 tolerance = 0.0f);
+
+    solver_e solver() const { return m_solver; }
+
+    /** Split every step into 'substeps' equal ones, each runs whole pipeline
+     *  with solver passes set by set_solver(). With XPBD, more substeps of
+     *  one pass converge better than more passes at the same cost.
+     */
+    void set_substeps(i32 substeps);
+
+    i32 substeps() const { return m_substeps; }
+
+    /// Solver work of last substep, totals count substeps.
+    solver_stats_t const &solver_stats() const { return m_solver_stats; }
+
+    /// Particle collisions, on by default.
+    void set_collisions(bool collisions) { m_collisions = collisions; }
+
+    bool collisions() const { return m_collisions; }
+
+    /** Islands still for 'steps' steps in a row, kinetic energy per mass of
+     *  every particle below 'energy', stop integration and constraint
+     *  passes until something moves them. On by default.
+     */
+    void set_sleeping(bool sleeping, f32 energy = OGP_PHYSICS_SLEEP_ENERGY, i32 steps = OGP_PHYSICS_SLEEP_STEPS);
+
+    bool sleeping() const { return m_sleeping; }
+
+    /// Wake island of body, forces and moving particles wake it too.
+    void wake_body(body_t body);
+
+    bool body_sleeping(body_t body) const;
+
+    i32 num_islands() const { return static_cast<i32>(m_islands.islands.size()); }
+
+    i32 num_sleeping_islands() const;
+
+    /// RMS of relative constraint length error at current positions.
+    f32 constraint_error() const;
+
+    /// Steps done so far, restore_snapshot() goes back.
+    i64 frame() const { return m_frame; }
+
+    /// Keep last 'num' saved frames, drops all saved ones.
+    void set_num_snapshots(i32 num);
+
+    /** Save world state of current frame into ring buffer: particles,
+     *  bodies, constraints, springs, pins, body lists and islands. Every
+     *  pool is a few memcpy blocks, nothing is allocated once the ring slot
+     *  has grown to world size. Colliders are scenery and are not saved.
+     *  Returns saved frame.
+     */
+    i64 save_snapshot();
+
+    /** Go back to world state saved at 'frame', handles valid then are valid
+     *  again. Snapshots of later frames are dropped. Returns false if frame
+     *  is no longer in ring buffer.
+     */
+    bool restore_snapshot(i64 frame);
+
+    /// Bytes of snapshot of 'frame', 0 if it is not in ring buffer.
+    size_t snapshot_size(i64 frame) const;
+
+    /** Hash of bits of current and previous positions of all particles,
+     *  in row order. Same steps give same hash with any number of threads,
+     *  and on every machine in OGP_DETERMINISTIC builds.
+     */
+    u64 state_hash() const;
+
     body_t create_body(body_type_e body_type);
 
     void destroy_body(body_t body);
@@ -150,11 +561,46 @@ public:
 
     void destroy_constraint(constraint_t constraint);
 
+    /** Inverse stiffness of constraint, length error per unit of force.
+     *  Used by XPBD solver only, others keep every constraint rigid.
+     */
+    void set_constraint_compliance(constraint_t constraint, f32 compliance);
+
+    /** Damped spring between particles, rest length is their current
+     *  distance. Explicit force, stays stable while stiffness / mass is
+     *  well below 1 / dt^2.
+     */
+    spring_t create_spring(body_t body_A, particle_t particle_A, body_t body_B, particle_t particle_B, f32 stiffness, f32 damping);
+
+    void destroy_spring(spring_t spring);
+
+    bool spring_exists(spring_t spring) const;
+
     pin_t create_pin(body_t body_master, particle_t master, body_t body_slave, particle_t slave);
 
     void destroy_pin(pin_t pin);
 
-    bool is_pinned(particle_t particle);
+    bool is_pinned(particle_t particle) const;
+
+    /// Plane with points p of dot(normal, p) >= offset outside.
+    collider_t create_plane(vec3 normal, f32 offset);
+
+    collider_t create_sphere(vec3 center, f32 radius);
+
+    /// Segment [a, b] grown by radius.
+    collider_t create_capsule(vec3 a, vec3 b, f32 radius);
+
+    collider_t create_box(vec3 center, quat orientation, vec3 half_extents);
+
+    /// Static triangle soup, 3 world positions per triangle, collided through BVH.
+    collider_t create_triangle_mesh(std::vector<vec3> const &vertices);
+
+    /// Closest hit of ray origin + t * direction against mesh colliders, t up to max_t.
+    bool raycast(vec3 origin, vec3 direction, f32 max_t, ray_hit_t *hit, collider_t *collider = nullptr) const;
+
+    void destroy_collider(collider_t collider);
+
+    bool collider_exists(collider_t collider) const;
 
     void set_force(body_t body, vec3 force);
 
@@ -164,15 +610,15 @@ public:
 
     void set_particle_pos(particle_t particle, vec3 pos);
 
-    void debug_draw(render_context_t *rc, f32 frame_dt);
+    /// Collision radius, 0.01 by default.
+    void set_particle_radius(particle_t particle, f32 radius);
 
-    void debug_print_stats() const;
-};
+    /// Heavier particles move less when constraints are projected.
+    void set_particle_mass(particle_t particle, f32 mass);
 
-struct spring_t
-{
-    i32 index_p0;
-    i32 index_p1;
+    void debug_draw(render_recorder_t *rc, f32 frame_dt);
+
+    void debug_print_stats() const;
 };
 
 // void physics_move(p_particles_t &p_particles);
@@ -0,0 +1,55 @@
+#include "ogp_physics_broadphase.h"
+
+#include "ogp_jobs.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ogp
+{
+
+void spatial_hash_t::build(vec3 const *points, i32 num, f32 cell_size)
+{
+    assert(cell_size > 0.0f);
+
+    m_cell_size = cell_size;
+    m_inv_cell_size = 1.0f / cell_size;
+
+    // At least 4, so 3 buckets of a row are distinct
+    u32 num_buckets = 4;
+    while (num_buckets < 2 * static_cast<u32>(std::max(num, 1))) {
+        num_buckets <<= 1;
+    }
+    m_mask = num_buckets - 1;
+
+    // Same sizes step after step, no reallocation
+    m_point_cells.resize(num);
+    m_bucket_starts.assign(num_buckets + 1, 0);
+    m_cursors.resize(num_buckets);
+    m_entries.resize(num);
+    m_entry_cells.resize(num);
+
+    jobs().parallel_for(0, num, OGP_PHYSICS_GRAIN, [this, points](i32 begin, i32 end) {
+        for (i32 i = begin; i < end; ++i) {
+            vec3 p = points[i];
+            m_point_cells[i] = cell_key(cell_coord(p.x), cell_coord(p.y), cell_coord(p.z));
+        }
+    });
+
+    // Counting sort, points keep ascending order inside a bucket
+    for (i32 i = 0; i < num; ++i) {
+        m_bucket_starts[bucket(m_point_cells[i]) + 1]++;
+    }
+    for (u32 b = 0; b < num_buckets; ++b) {
+        m_bucket_starts[b + 1] += m_bucket_starts[b];
+    }
+
+    std::copy(m_bucket_starts.begin(), m_bucket_starts.end() - 1, m_cursors.begin());
+    for (i32 i = 0; i < num; ++i) {
+        i32 e = m_cursors[bucket(m_point_cells[i])]++;
+        m_entries[e] = i;
+        m_entry_cells[e] = m_point_cells[i];
+    }
+}
+
+}  // namespace ogp
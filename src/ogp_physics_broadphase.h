@@ -0,0 +1,121 @@
+#ifndef OGP_PHYSICS_BROADPHASE_H
+#define OGP_PHYSICS_BROADPHASE_H
+
+#include "ogp_defines.h"
+
+#include <cmath>
+#include <vector>
+
+namespace ogp
+{
+
+/** Uniform grid over unbounded space, cells hashed into a table of power of
+ *  two size. Rows of cells along x are hashed, cells of a row go to adjacent
+ *  buckets, so a query scans 9 ranges instead of 27 buckets. Rebuilt from
+ *  scratch with a counting sort, points of one bucket are contiguous and in
+ *  ascending order. Entries keep their cell key, so cells sharing a bucket
+ *  are told apart. Callers check real distance.
+ */
+class spatial_hash_t
+{
+    f32 m_cell_size {1.0f};
+    f32 m_inv_cell_size {1.0f};
+    u32 m_mask {0};
+
+    std::vector<u64> m_point_cells;    // cell key of every point
+    std::vector<i32> m_bucket_starts;  // bucket b is [starts[b], starts[b + 1]) in m_entries
+    std::vector<i32> m_cursors;        // scatter position of every bucket
+    std::vector<i32> m_entries;        // point indices sorted by bucket
+    std::vector<u64> m_entry_cells;    // cell keys of m_entries
+
+    i32 cell_coord(f32 v) const
+    {
+        return static_cast<i32>(std::floor(v * m_inv_cell_size));
+    }
+
+    static constexpr u64 COORD_BITS = 21;
+    static constexpr u64 COORD_MASK = (u64(1) << COORD_BITS) - 1;
+
+    /// x in low bits, row (y, z) above, cells wrap every 2^21 cells.
+    static u64 cell_key(i32 x, i32 y, i32 z)
+    {
+        return (static_cast<u64>(x) & COORD_MASK) | (row_key(y, z) << COORD_BITS);
+    }
+
+    static u64 row_key(i32 y, i32 z)
+    {
+        return (static_cast<u64>(y) & COORD_MASK) | ((static_cast<u64>(z) & COORD_MASK) << COORD_BITS);
+    }
+
+    u32 row_bucket(u64 row) const
+    {
+        return static_cast<u32>((row * 0x9E3779B97F4A7C15ull) >> 32);
+    }
+
+    u32 bucket(u64 key) const
+    {
+        return (row_bucket(key >> COORD_BITS) + static_cast<u32>(key & COORD_MASK)) & m_mask;
+    }
+
+    /// Entries of [first, last) with row 'row' and x in [x0, x0 + 3).
+    template <typename F>
+    void scan(i32 first, i32 last, u64 row, u32 x0, F &fn) const
+    {
+        for (i32 e = first; e < last; ++e) {
+            u64 key = m_entry_cells[e];
+            bool in_row = (key >> COORD_BITS) == row;
+            bool in_range = ((static_cast<u32>(key & COORD_MASK) - x0) & COORD_MASK) < 3;
+            if (in_row && in_range) fn(m_entries[e]);
+        }
+    }
+
+public:
+
+    /// Hash 'num' points into cells of 'cell_size' > 0, table has at least 2 buckets per point.
+    void build(vec3 const *points, i32 num, f32 cell_size);
+
+    /** Call fn(point) once for every point in 3x3x3 cells around 'center',
+     *  which covers all points closer than cell size. Order is the same
+     *  on every call.
+     */
+    template <typename F>
+    void query(vec3 center, F fn) const
+    {
+        i32 cx = cell_coord(center.x);
+        i32 cy = cell_coord(center.y);
+        i32 cz = cell_coord(center.z);
+
+        u32 x0 = static_cast<u32>(cx - 1) & COORD_MASK;
+        u32 num_buckets = m_mask + 1;
+
+        for (i32 z = cz - 1; z <= cz + 1; ++z) {
+            for (i32 y = cy - 1; y <= cy + 1; ++y) {
+                u64 row = row_key(y, z);
+                u32 b = bucket(x0 | (row << COORD_BITS));
+
+                // 3 buckets of row, may wrap around table end
+                if (b + 3 <= num_buckets) {
+                    scan(m_bucket_starts[b], m_bucket_starts[b + 3], row, x0, fn);
+                }
+                else {
+                    scan(m_bucket_starts[b], m_bucket_starts[num_buckets], row, x0, fn);
+                    scan(m_bucket_starts[0], m_bucket_starts[(b + 3) & m_mask], row, x0, fn);
+                }
+            }
+        }
+    }
+
+    f32 cell_size() const
+    {
+        return m_cell_size;
+    }
+
+    i32 num_buckets() const
+    {
+        return static_cast<i32>(m_mask) + 1;
+    }
+};
+
+}  // namespace ogp
+
+#endif  // OGP_PHYSICS_BROADPHASE_H
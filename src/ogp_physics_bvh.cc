@@ -0,0 +1,356 @@
+#include "ogp_physics_bvh.h"
+
+#include "ogp_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace ogp
+{
+
+namespace
+{
+
+struct aabb_t
+{
+    vec3 min {std::numeric_limits<f32>::max()};
+    vec3 max {-std::numeric_limits<f32>::max()};
+
+    void grow(vec3 p)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void grow(aabb_t const &other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    f32 area() const
+    {
+        vec3 e = max - min;
+        return (e.x < 0.0f) ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+struct bin_t
+{
+    aabb_t bounds;
+    i32 count {0};
+};
+
+struct build_task_t
+{
+    i32 node;
+    i32 depth;
+};
+
+}  // namespace
+
+vec3 closest_point_on_triangle(vec3 p, vec3 a, vec3 b, vec3 c)
+{
+    // Voronoi regions of vertices, edges and face, Real-Time Collision Detection 5.1.5
+    vec3 ab = b - a;
+    vec3 ac = c - a;
+    vec3 ap = p - a;
+
+    f32 d1 = glm::dot(ab, ap);
+    f32 d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    vec3 bp = p - b;
+    f32 d3 = glm::dot(ab, bp);
+    f32 d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    f32 vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    vec3 cp = p - c;
+    f32 d5 = glm::dot(ab, cp);
+    f32 d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    f32 vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    f32 va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    f32 denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+bool bvh_t::overlaps_sphere(node_t const &node, vec3 center, f32 radius)
+{
+    vec3 closest = glm::clamp(center, node.min, node.max);
+    vec3 delta = center - closest;
+    return glm::dot(delta, delta) <= radius * radius;
+}
+
+void bvh_t::build(vec3 const *vertices, i32 num_triangles)
+{
+    m_nodes.clear();
+    m_vertices.clear();
+    m_triangle_ids.clear();
+    m_depth = 0;
+
+    if (num_triangles <= 0) return;
+
+    std::vector<aabb_t> boxes(num_triangles);
+    std::vector<vec3> centroids(num_triangles);
+    std::vector<i32> order(num_triangles);
+    std::iota(order.begin(), order.end(), 0);
+
+    for (i32 t = 0; t < num_triangles; ++t) {
+        boxes[t].grow(vertices[3 * t + 0]);
+        boxes[t].grow(vertices[3 * t + 1]);
+        boxes[t].grow(vertices[3 * t + 2]);
+        centroids[t] = (boxes[t].min + boxes[t].max) * 0.5f;
+    }
+
+    // Binary tree of leaves with at least one triangle, never more nodes
+    m_nodes.reserve(2 * num_triangles);
+    m_nodes.push_back(node_t {vec3 {0.0f}, 0, vec3 {0.0f}, num_triangles});
+
+    std::vector<build_task_t> tasks;
+    tasks.push_back(build_task_t {0, 1});
+
+    while (!tasks.empty()) {
+        build_task_t task = tasks.back();
+        tasks.pop_back();
+        m_depth = std::max(m_depth, task.depth);
+
+        i32 first = m_nodes[task.node].first;
+        i32 count = m_nodes[task.node].count;
+
+        aabb_t bounds;
+        aabb_t centroid_bounds;
+        for (i32 k = first; k < first + count; ++k) {
+            bounds.grow(boxes[order[k]]);
+            centroid_bounds.grow(centroids[order[k]]);
+        }
+        m_nodes[task.node].min = bounds.min;
+        m_nodes[task.node].max = bounds.max;
+
+        if (count <= MAX_LEAF_TRIANGLES || task.depth >= MAX_DEPTH - 1) continue;
+
+        // Cheapest split over bins of all 3 axes, cost in triangle tests
+        f32 best_cost = std::numeric_limits<f32>::max();
+        i32 best_axis = -1;
+        i32 best_split = 0;
+
+        for (i32 axis = 0; axis < 3; ++axis) {
+            f32 lo = centroid_bounds.min[axis];
+            f32 extent = centroid_bounds.max[axis] - lo;
+            if (extent <= 0.0f) continue;
+
+            f32 scale = NUM_BINS / extent;
+            bin_t bins[NUM_BINS];
+            for (i32 k = first; k < first + count; ++k) {
+                i32 b = std::min(NUM_BINS - 1, static_cast<i32>((centroids[order[k]][axis] - lo) * scale));
+                bins[b].bounds.grow(boxes[order[k]]);
+                bins[b].count++;
+            }
+
+            // Right sides swept from the end, left sides from the start
+            f32 right_area[NUM_BINS];
+            i32 right_count[NUM_BINS];
+            aabb_t right;
+            i32 num_right = 0;
+            for (i32 b = NUM_BINS - 1; b > 0; --b) {
+                right.grow(bins[b].bounds);
+                num_right += bins[b].count;
+                right_area[b] = right.area();
+                right_count[b] = num_right;
+            }
+
+            aabb_t left;
+            i32 num_left = 0;
+            for (i32 split = 1; split < NUM_BINS; ++split) {
+                left.grow(bins[split - 1].bounds);
+                num_left += bins[split - 1].count;
+                if (num_left == 0 || right_count[split] == 0) continue;
+
+                f32 cost = left.area() * num_left + right_area[split] * right_count[split];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+
+        // Leaf when every split costs more than testing all triangles,
+        // unless the leaf would be too big
+        f32 leaf_cost = bounds.area() * count;
+        bool split_pays = (best_axis != -1) && (best_cost < leaf_cost);
+        if (!split_pays && count <= 4 * MAX_LEAF_TRIANGLES) continue;
+
+        i32 *begin = order.data() + first;
+        i32 *end = begin + count;
+        i32 *middle = begin + count / 2;
+
+        if (best_axis != -1) {
+            f32 lo = centroid_bounds.min[best_axis];
+            f32 scale = NUM_BINS / (centroid_bounds.max[best_axis] - lo);
+            middle = std::partition(begin, end, [&](i32 t) {
+                return std::min(NUM_BINS - 1, static_cast<i32>((centroids[t][best_axis] - lo) * scale)) < best_split;
+            });
+        }
+        else {
+            // All centroids in one point, any halves do
+            middle = begin + count / 2;
+        }
+
+        i32 num_left = static_cast<i32>(middle - begin);
+
+        i32 left = static_cast<i32>(m_nodes.size());
+        m_nodes.push_back(node_t {vec3 {0.0f}, first, vec3 {0.0f}, num_left});
+        m_nodes.push_back(node_t {vec3 {0.0f}, first + num_left, vec3 {0.0f}, count - num_left});
+
+        m_nodes[task.node].first = left;
+        m_nodes[task.node].count = 0;
+
+        tasks.push_back(build_task_t {left, task.depth + 1});
+        tasks.push_back(build_task_t {left + 1, task.depth + 1});
+    }
+
+    m_vertices.resize(3 * num_triangles);
+    m_triangle_ids = order;
+    for (i32 k = 0; k < num_triangles; ++k) {
+        m_vertices[3 * k + 0] = vertices[3 * order[k] + 0];
+        m_vertices[3 * k + 1] = vertices[3 * order[k] + 1];
+        m_vertices[3 * k + 2] = vertices[3 * order[k] + 2];
+    }
+
+    ogp_log_debug("BVH built: %d triangles, %d nodes, depth %d", num_triangles, num_nodes(), m_depth);
+}
+
+bool bvh_t::raycast(vec3 origin, vec3 direction, f32 max_t, ray_hit_t *hit) const
+{
+    if (m_nodes.empty()) return false;
+
+    vec3 inv_dir = vec3 {1.0f} / direction;
+    f32 closest_t = max_t;
+    i32 closest = -1;
+
+    // Slab test, entry distance or infinity when missed
+    auto enter = [&](node_t const &node) {
+        vec3 t0 = (node.min - origin) * inv_dir;
+        vec3 t1 = (node.max - origin) * inv_dir;
+        vec3 t_near = glm::min(t0, t1);
+        vec3 t_far = glm::max(t0, t1);
+        f32 t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+        f32 t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, closest_t));
+        return (t_enter <= t_exit) ? t_enter : std::numeric_limits<f32>::max();
+    };
+
+    i32 stack[MAX_DEPTH];
+    i32 top = 0;
+    if (enter(m_nodes[0]) != std::numeric_limits<f32>::max()) stack[top++] = 0;
+
+    while (top > 0) {
+        node_t const &node = m_nodes[stack[--top]];
+
+        if (node.count > 0) {
+            for (i32 t = node.first; t < node.first + node.count; ++t) {
+                // Moller-Trumbore
+                vec3 a = m_vertices[3 * t + 0];
+                vec3 e1 = m_vertices[3 * t + 1] - a;
+                vec3 e2 = m_vertices[3 * t + 2] - a;
+
+                vec3 p = glm::cross(direction, e2);
+                f32 det = glm::dot(e1, p);
+                if (std::abs(det) < 1e-12f) continue;
+
+                f32 inv_det = 1.0f / det;
+                vec3 s = origin - a;
+                f32 u = glm::dot(s, p) * inv_det;
+                if (u < 0.0f || u > 1.0f) continue;
+
+                vec3 q = glm::cross(s, e1);
+                f32 v = glm::dot(direction, q) * inv_det;
+                if (v < 0.0f || u + v > 1.0f) continue;
+
+                f32 t_hit = glm::dot(e2, q) * inv_det;
+                if (t_hit >= 0.0f && t_hit <= closest_t) {
+                    closest_t = t_hit;
+                    closest = t;
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top, farther one may be culled by then
+        f32 t_left = enter(m_nodes[node.first]);
+        f32 t_right = enter(m_nodes[node.first + 1]);
+        i32 near_child = node.first;
+        i32 far_child = node.first + 1;
+        if (t_right < t_left) {
+            std::swap(near_child, far_child);
+            std::swap(t_left, t_right);
+        }
+        if (t_right != std::numeric_limits<f32>::max()) stack[top++] = far_child;
+        if (t_left != std::numeric_limits<f32>::max()) stack[top++] = near_child;
+    }
+
+    if (closest == -1) return false;
+
+    if (hit != nullptr) {
+        vec3 a = m_vertices[3 * closest + 0];
+        vec3 normal = glm::normalize(glm::cross(m_vertices[3 * closest + 1] - a, m_vertices[3 * closest + 2] - a));
+
+        hit->t = closest_t;
+        hit->point = origin + direction * closest_t;
+        hit->normal = (glm::dot(normal, direction) > 0.0f) ? -normal : normal;
+        hit->triangle = m_triangle_ids[closest];
+    }
+
+    return true;
+}
+
+bool bvh_t::push_out(vec3 *center, f32 radius, vec3 from) const
+{
+    vec3 p = *center;
+    f32 best_d2 = radius * radius;
+    vec3 best_point {0.0f};
+    i32 best = -1;
+
+    query_sphere(p, radius, [&](i32 t) {
+        vec3 q = closest_point_on_triangle(p, m_vertices[3 * t + 0], m_vertices[3 * t + 1], m_vertices[3 * t + 2]);
+        vec3 delta = p - q;
+        f32 d2 = glm::dot(delta, delta);
+        if (d2 < best_d2) {
+            best_d2 = d2;
+            best_point = q;
+            best = t;
+        }
+    });
+
+    if (best == -1) return false;
+
+    // Face normal on the side center came from
+    vec3 a = m_vertices[3 * best + 0];
+    vec3 face = glm::normalize(glm::cross(m_vertices[3 * best + 1] - a, m_vertices[3 * best + 2] - a));
+    f32 side_from = glm::dot(from - best_point, face);
+    f32 side_now = glm::dot(p - best_point, face);
+    if ((side_from != 0.0f ? side_from : side_now) < 0.0f) face = -face;
+
+    // Center on the surface or behind it, out along face normal
+    vec3 normal = face;
+    if (best_d2 > 1e-12f && glm::dot(p - best_point, face) > 0.0f) {
+        normal = (p - best_point) / std::sqrt(best_d2);
+    }
+
+    *center = best_point + normal * radius;
+    return true;
+}
+
+}  // namespace ogp
@@ -0,0 +1,112 @@
+#ifndef OGP_PHYSICS_BVH_H
+#define OGP_PHYSICS_BVH_H
+
+#include "ogp_defines.h"
+
+#include <vector>
+
+namespace ogp
+{
+
+struct ray_hit_t
+{
+    f32 t {0.0f};         // distance along ray direction, in direction lengths
+    vec3 point {0.0f, 0.0f, 0.0f};
+    vec3 normal {0.0f, 0.0f, 0.0f};  // unit, faces ray origin
+    i32 triangle {-1};    // in build order
+};
+
+/// Closest point of triangle (a, b, c) to p.
+vec3 closest_point_on_triangle(vec3 p, vec3 a, vec3 b, vec3 c);
+
+/** Bounding volume hierarchy over static triangle soup.
+ *  Built top down with binned surface area heuristic. Nodes are one array,
+ *  children of a node are next to each other, triangles are copied in leaf
+ *  order so a leaf reads one contiguous range.
+ */
+class bvh_t
+{
+    struct node_t
+    {
+        vec3 min;
+        i32 first;  // inner: left child, right one follows; leaf: first triangle
+        vec3 max;
+        i32 count;  // 0 for inner nodes
+    };
+
+    std::vector<node_t> m_nodes;
+    std::vector<vec3> m_vertices;     // 3 per triangle, leaf order
+    std::vector<i32> m_triangle_ids;  // build order of triangles, leaf order
+    i32 m_depth {0};
+
+    static bool overlaps_sphere(node_t const &node, vec3 center, f32 radius);
+
+public:
+
+    static constexpr i32 MAX_LEAF_TRIANGLES = 4;
+    static constexpr i32 NUM_BINS = 16;
+    static constexpr i32 MAX_DEPTH = 64;
+
+    /// Build from 'num_triangles' triangles, 3 positions each.
+    void build(vec3 const *vertices, i32 num_triangles);
+
+    /// Closest hit along origin + t * direction, 0 <= t <= max_t.
+    bool raycast(vec3 origin, vec3 direction, f32 max_t, ray_hit_t *hit) const;
+
+    /// Call fn(triangle) for triangles of all leaves touching sphere, triangle in leaf order.
+    template <typename F>
+    void query_sphere(vec3 center, f32 radius, F fn) const
+    {
+        if (m_nodes.empty()) return;
+
+        i32 stack[MAX_DEPTH];
+        i32 top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            node_t const &node = m_nodes[stack[--top]];
+            if (!overlaps_sphere(node, center, radius)) continue;
+
+            if (node.count > 0) {
+                for (i32 t = node.first; t < node.first + node.count; ++t) {
+                    fn(t);
+                }
+            }
+            else {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+    }
+
+    /** Move sphere out of surface along the direction from its closest
+     *  point, false if sphere does not touch any triangle. A center which
+     *  went through the face since 'from' goes back out along face normal.
+     */
+    bool push_out(vec3 *center, f32 radius, vec3 from) const;
+
+    /// Vertex 'k' of triangle in leaf order.
+    vec3 vertex(i32 triangle, i32 k) const
+    {
+        return m_vertices[3 * triangle + k];
+    }
+
+    i32 num_triangles() const
+    {
+        return static_cast<i32>(m_triangle_ids.size());
+    }
+
+    i32 num_nodes() const
+    {
+        return static_cast<i32>(m_nodes.size());
+    }
+
+    i32 depth() const
+    {
+        return m_depth;
+    }
+};
+
+}  // namespace ogp
+
+#endif  // OGP_PHYSICS_BVH_H
@@ -0,0 +1,438 @@
+#include "ogp_physics_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ogp
+{
+
+static_assert(sizeof(vec3) == 3 * sizeof(f32), "vec3 columns are read as flat f32 arrays");
+
+static inline void verlet_particle(verlet_columns_t const &c, i32 i, vec3 gravity, f32 dt2, f32 half_inv_dt)
+{
+    if (c.integrate[i] == 0.0f) return;
+
+    f32 k = dt2 / c.mass[i];
+
+    vec3 r_prev = c.position_prev[i];
+    vec3 r_next = c.position_now[i] * 2.0f - r_prev + (c.force[i] + gravity) * k;
+
+    c.position_next[i] = r_next;
+    c.velocity_next[i] = (r_next - r_prev) * half_inv_dt;
+}
+
+void verlet_integrate_scalar(verlet_columns_t const &columns, i32 begin, i32 end, vec3 gravity, f32 dt)
+{
+    f32 dt2 = dt * dt;
+    f32 half_inv_dt = 0.5f / dt;
+
+    for (i32 i = begin; i < end; ++i) {
+        verlet_particle(columns, i, gravity, dt2, half_inv_dt);
+    }
+}
+
+#if defined(__AVX2__)
+
+// 8 particles are 24 floats, 3 registers. Per particle values are spread
+// over their x, y, z lanes with these permutations.
+
+void verlet_integrate(verlet_columns_t const &c, i32 begin, i32 end, vec3 gravity, f32 dt)
+{
+    f32 dt2 = dt * dt;
+    f32 half_inv_dt = 0.5f / dt;
+
+    __m256i const spread[3] = {
+        _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2),
+        _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5),
+        _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7),
+    };
+
+    f32 gx = gravity.x, gy = gravity.y, gz = gravity.z;
+    __m256 const g[3] = {
+        _mm256_setr_ps(gx, gy, gz, gx, gy, gz, gx, gy),
+        _mm256_setr_ps(gz, gx, gy, gz, gx, gy, gz, gx),
+        _mm256_setr_ps(gy, gz, gx, gy, gz, gx, gy, gz),
+    };
+
+    __m256 const two = _mm256_set1_ps(2.0f);
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const v_dt2 = _mm256_set1_ps(dt2);
+    __m256 const v_half_inv_dt = _mm256_set1_ps(half_inv_dt);
+
+    i32 i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 k8 = _mm256_div_ps(v_dt2, _mm256_loadu_ps(c.mass + i));
+        __m256 w8 = _mm256_loadu_ps(c.integrate + i);
+
+        f32 const *prev = &c.position_prev[i].x;
+        f32 const *now = &c.position_now[i].x;
+        f32 const *force = &c.force[i].x;
+        f32 *next = &c.position_next[i].x;
+        f32 *vel = &c.velocity_next[i].x;
+
+        for (i32 r = 0; r < 3; ++r) {
+            __m256 k = _mm256_permutevar8x32_ps(k8, spread[r]);
+            __m256 mask = _mm256_cmp_ps(_mm256_permutevar8x32_ps(w8, spread[r]), zero, _CMP_NEQ_OQ);
+
+            __m256 r_prev = _mm256_loadu_ps(prev + 8 * r);
+            __m256 r_now = _mm256_loadu_ps(now + 8 * r);
+            __m256 f = _mm256_add_ps(_mm256_loadu_ps(force + 8 * r), g[r]);
+
+            __m256 r_next = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(r_now, two), r_prev), _mm256_mul_ps(f, k));
+            __m256 v_next = _mm256_mul_ps(_mm256_sub_ps(r_next, r_prev), v_half_inv_dt);
+
+            r_next = _mm256_blendv_ps(_mm256_loadu_ps(next + 8 * r), r_next, mask);
+            v_next = _mm256_blendv_ps(_mm256_loadu_ps(vel + 8 * r), v_next, mask);
+
+            _mm256_storeu_ps(next + 8 * r, r_next);
+            _mm256_storeu_ps(vel + 8 * r, v_next);
+        }
+    }
+
+    for (; i < end; ++i) {
+        verlet_particle(c, i, gravity, dt2, half_inv_dt);
+    }
+}
+
+char const *verlet_integrate_isa()
+{
+    return "avx2";
+}
+
+#elif defined(__SSE2__)
+
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+void verlet_integrate(verlet_columns_t const &c, i32 begin, i32 end, vec3 gravity, f32 dt)
+{
+    f32 dt2 = dt * dt;
+    f32 half_inv_dt = 0.5f / dt;
+
+    f32 gx = gravity.x, gy = gravity.y, gz = gravity.z;
+    __m128 const g[3] = {
+        _mm_setr_ps(gx, gy, gz, gx),
+        _mm_setr_ps(gy, gz, gx, gy),
+        _mm_setr_ps(gz, gx, gy, gz),
+    };
+
+    __m128 const two = _mm_set1_ps(2.0f);
+    __m128 const zero = _mm_setzero_ps();
+    __m128 const v_dt2 = _mm_set1_ps(dt2);
+    __m128 const v_half_inv_dt = _mm_set1_ps(half_inv_dt);
+
+    i32 i = begin;
+    for (; i + 4 <= end; i += 4) {
+        // 4 particles are 12 floats, 3 registers, per particle values
+        // go to lanes [0 0 0 1] [1 1 2 2] [2 3 3 3]
+        __m128 k4 = _mm_div_ps(v_dt2, _mm_loadu_ps(c.mass + i));
+        __m128 w4 = _mm_loadu_ps(c.integrate + i);
+
+        __m128 k[3] = {
+            _mm_shuffle_ps(k4, k4, _MM_SHUFFLE(1, 0, 0, 0)),
+            _mm_shuffle_ps(k4, k4, _MM_SHUFFLE(2, 2, 1, 1)),
+            _mm_shuffle_ps(k4, k4, _MM_SHUFFLE(3, 3, 3, 2)),
+        };
+        __m128 mask[3] = {
+            _mm_cmpneq_ps(_mm_shuffle_ps(w4, w4, _MM_SHUFFLE(1, 0, 0, 0)), zero),
+            _mm_cmpneq_ps(_mm_shuffle_ps(w4, w4, _MM_SHUFFLE(2, 2, 1, 1)), zero),
+            _mm_cmpneq_ps(_mm_shuffle_ps(w4, w4, _MM_SHUFFLE(3, 3, 3, 2)), zero),
+        };
+
+        f32 const *prev = &c.position_prev[i].x;
+        f32 const *now = &c.position_now[i].x;
+        f32 const *force = &c.force[i].x;
+        f32 *next = &c.position_next[i].x;
+        f32 *vel = &c.velocity_next[i].x;
+
+        for (i32 r = 0; r < 3; ++r) {
+            __m128 r_prev = _mm_loadu_ps(prev + 4 * r);
+            __m128 r_now = _mm_loadu_ps(now + 4 * r);
+            __m128 f = _mm_add_ps(_mm_loadu_ps(force + 4 * r), g[r]);
+
+            __m128 r_next = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(r_now, two), r_prev), _mm_mul_ps(f, k[r]));
+            __m128 v_next = _mm_mul_ps(_mm_sub_ps(r_next, r_prev), v_half_inv_dt);
+
+            _mm_storeu_ps(next + 4 * r, select_ps(mask[r], r_next, _mm_loadu_ps(next + 4 * r)));
+            _mm_storeu_ps(vel + 4 * r, select_ps(mask[r], v_next, _mm_loadu_ps(vel + 4 * r)));
+        }
+    }
+
+    for (; i < end; ++i) {
+        verlet_particle(c, i, gravity, dt2, half_inv_dt);
+    }
+}
+
+char const *verlet_integrate_isa()
+{
+    return "sse2";
+}
+
+#else
+
+void verlet_integrate(verlet_columns_t const &columns, i32 begin, i32 end, vec3 gravity, f32 dt)
+{
+    verlet_integrate_scalar(columns, begin, end, gravity, dt);
+}
+
+char const *verlet_integrate_isa()
+{
+    return "scalar";
+}
+
+#endif
+
+// COLLIDERS ...................................................................
+
+// Shapes come by value, so compiler keeps them in registers instead of
+// reloading through pointers which may alias positions. Most particles are
+// far from most shapes, early outs before square roots are well predicted.
+
+/// Move particle by 'push' along normal, if it is movable and push is positive.
+static inline void push_out(collider_columns_t const &c, i32 i, vec3 normal, f32 push)
+{
+    f32 movable = (c.inv_mass[i] > 0.0f) ? 1.0f : 0.0f;
+    f32 amount = 0.5f * (push + std::abs(push));  // max(push, 0) without a branch
+    c.position_next[i] += normal * (amount * movable);
+}
+
+/// Push out of sphere of 'radius' around 'center', particle at center stays.
+static inline void push_from_point(collider_columns_t const &c, i32 i, vec3 center, f32 radius)
+{
+    vec3 delta = c.position_next[i] - center;
+    f32 d2 = glm::dot(delta, delta);
+    f32 contact = radius + c.radius[i];
+    if (d2 >= contact * contact || d2 == 0.0f) return;
+
+    f32 d = std::sqrt(d2);
+    push_out(c, i, delta / d, contact - d);
+}
+
+static void collide_planes(collider_columns_t const &c, i32 begin, i32 end, plane_shape_t const plane)
+{
+    for (i32 i = begin; i < end; ++i) {
+        f32 distance = glm::dot(plane.normal, c.position_next[i]) - plane.offset;
+        push_out(c, i, plane.normal, c.radius[i] - distance);
+    }
+}
+
+static void collide_spheres(collider_columns_t const &c, i32 begin, i32 end, sphere_shape_t const sphere)
+{
+    for (i32 i = begin; i < end; ++i) {
+        push_from_point(c, i, sphere.center, sphere.radius);
+    }
+}
+
+static void collide_capsules(collider_columns_t const &c, i32 begin, i32 end, capsule_shape_t const capsule)
+{
+    vec3 ab = capsule.b - capsule.a;
+    f32 ab2 = glm::dot(ab, ab);
+    f32 inv_ab2 = (ab2 > 0.0f) ? 1.0f / ab2 : 0.0f;
+
+    for (i32 i = begin; i < end; ++i) {
+        f32 t = glm::clamp(glm::dot(c.position_next[i] - capsule.a, ab) * inv_ab2, 0.0f, 1.0f);
+        push_from_point(c, i, capsule.a + ab * t, capsule.radius);
+    }
+}
+
+static void collide_boxes(collider_columns_t const &c, i32 begin, i32 end, box_shape_t const box)
+{
+    mat3 to_local = glm::transpose(box.axes);
+    vec3 h = box.half_extents;
+
+    for (i32 i = begin; i < end; ++i) {
+        vec3 q = to_local * (c.position_next[i] - box.center);
+        vec3 outside = q - glm::clamp(q, -h, h);
+        f32 d2 = glm::dot(outside, outside);
+
+        if (d2 > 0.0f) {
+            f32 d = std::sqrt(d2);
+            push_out(c, i, box.axes * (outside / d), c.radius[i] - d);
+            continue;
+        }
+
+        // Center inside, out through the nearest face, rare
+        vec3 depth = h - glm::abs(q);
+        i32 axis = (depth.x < depth.y) ? ((depth.x < depth.z) ? 0 : 2) : ((depth.y < depth.z) ? 1 : 2);
+        f32 side = (q[axis] < 0.0f) ? -1.0f : 1.0f;
+        push_out(c, i, box.axes[axis] * side, depth[axis] + c.radius[i]);
+    }
+}
+
+void collide_shapes(collider_columns_t const &columns, i32 begin, i32 end, collider_shapes_t const &shapes)
+{
+    // Blocks stay in L1 while all shapes pass over them
+    constexpr i32 BLOCK = 256;
+
+    for (i32 first = begin; first < end; first += BLOCK) {
+        i32 last = std::min(first + BLOCK, end);
+
+        for (i32 k = 0; k < shapes.num_planes; ++k) {
+            collide_planes(columns, first, last, shapes.planes[k]);
+        }
+        for (i32 k = 0; k < shapes.num_spheres; ++k) {
+            collide_spheres(columns, first, last, shapes.spheres[k]);
+        }
+        for (i32 k = 0; k < shapes.num_capsules; ++k) {
+            collide_capsules(columns, first, last, shapes.capsules[k]);
+        }
+        for (i32 k = 0; k < shapes.num_boxes; ++k) {
+            collide_boxes(columns, first, last, shapes.boxes[k]);
+        }
+    }
+}
+
+// SWEPT SPHERES ...............................................................
+
+// Moving sphere against a shape is a ray against the shape grown by radius.
+// Hits are fractions of delta, 1.0 is a miss, every test keeps the closest.
+
+/// Ray against sphere of 'radius' around 'center'.
+static inline void sweep_point(vec3 from, vec3 delta, vec3 center, f32 radius, f32 *t_hit, vec3 *normal)
+{
+    vec3 m = from - center;
+    f32 b = glm::dot(m, delta);
+    f32 c = glm::dot(m, m) - radius * radius;
+    if (b >= 0.0f || glm::dot(m, m) == 0.0f) return;  // moving away
+
+    f32 a = glm::dot(delta, delta);
+    f32 disc = b * b - a * c;
+    if (disc < 0.0f) return;
+
+    f32 t = std::max((-b - std::sqrt(disc)) / a, 0.0f);
+    if (t >= *t_hit) return;
+
+    *t_hit = t;
+    *normal = glm::normalize(m + delta * t);
+}
+
+static void sweep_plane(vec3 from, vec3 delta, f32 radius, plane_shape_t const &plane, f32 *t_hit, vec3 *normal)
+{
+    f32 distance = std::max(glm::dot(plane.normal, from) - plane.offset - radius, 0.0f);
+    f32 approach = -glm::dot(plane.normal, delta);
+    if (approach <= 0.0f || distance >= *t_hit * approach) return;
+
+    *t_hit = distance / approach;
+    *normal = plane.normal;
+}
+
+static void sweep_capsule(vec3 from, vec3 delta, f32 radius, capsule_shape_t const &capsule, f32 *t_hit, vec3 *normal)
+{
+    f32 contact = capsule.radius + radius;
+    vec3 ab = capsule.b - capsule.a;
+    vec3 m = from - capsule.a;
+    f32 ab2 = glm::dot(ab, ab);
+    f32 ab_m = glm::dot(ab, m);
+    f32 ab_d = glm::dot(ab, delta);
+
+    // Starts touching, stops unless moving out
+    f32 s = (ab2 > 0.0f) ? glm::clamp(ab_m / ab2, 0.0f, 1.0f) : 0.0f;
+    vec3 outside = m - ab * s;
+    f32 d2 = glm::dot(outside, outside);
+    if (d2 <= contact * contact) {
+        if (d2 > 0.0f && glm::dot(outside, delta) < 0.0f) {
+            *t_hit = 0.0f;
+            *normal = outside / std::sqrt(d2);
+        }
+        return;
+    }
+
+    // Side of the infinite cylinder, hit counts between end caps
+    f32 a = ab2 * glm::dot(delta, delta) - ab_d * ab_d;
+    f32 b = ab2 * glm::dot(m, delta) - ab_m * ab_d;
+    f32 c = ab2 * glm::dot(m, m) - ab_m * ab_m - contact * contact * ab2;
+    f32 disc = b * b - a * c;
+
+    if (a > 0.0f && b < 0.0f && disc >= 0.0f) {
+        f32 t = (-b - std::sqrt(disc)) / a;
+        f32 along = ab_m + t * ab_d;
+        if (t >= 0.0f && t < *t_hit && along > 0.0f && along < ab2) {
+            *t_hit = t;
+            *normal = glm::normalize(m + delta * t - ab * (along / ab2));
+        }
+    }
+
+    // End caps, union of shapes is entered at the first entry of any of them
+    sweep_point(from, delta, capsule.a, contact, t_hit, normal);
+    sweep_point(from, delta, capsule.b, contact, t_hit, normal);
+}
+
+static void sweep_box(vec3 from, vec3 delta, f32 radius, box_shape_t const &box, f32 *t_hit, vec3 *normal)
+{
+    mat3 to_local = glm::transpose(box.axes);
+    vec3 q = to_local * (from - box.center);
+    vec3 d = to_local * delta;
+    vec3 h = box.half_extents + vec3 {radius};
+
+    // Slabs, entry is the latest near side, before 0 when starting inside
+    f32 t_enter = -std::numeric_limits<f32>::max();
+    f32 t_exit = *t_hit;
+    i32 axis = -1;
+
+    for (i32 k = 0; k < 3; ++k) {
+        if (d[k] == 0.0f) {
+            if (q[k] < -h[k] || q[k] > h[k]) return;
+            continue;
+        }
+        f32 inv = 1.0f / d[k];
+        f32 t0 = (-h[k] - q[k]) * inv;
+        f32 t1 = (h[k] - q[k]) * inv;
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > t_enter) {
+            t_enter = t0;
+            axis = k;
+        }
+        t_exit = std::min(t_exit, t1);
+        if (t_enter > t_exit) return;
+    }
+
+    if (t_exit < 0.0f) return;
+
+    if (t_enter > 0.0f) {
+        *t_hit = t_enter;
+        *normal = box.axes[axis] * ((d[axis] > 0.0f) ? -1.0f : 1.0f);
+        return;
+    }
+
+    // Starts touching or in grown box, hit only when moving in through the
+    // nearest side, sliding along or leaving it is free
+    vec3 depth = h - glm::abs(q);
+    i32 nearest = (depth.x < depth.y) ? ((depth.x < depth.z) ? 0 : 2) : ((depth.y < depth.z) ? 1 : 2);
+    f32 side = (q[nearest] < 0.0f) ? -1.0f : 1.0f;
+    if (d[nearest] * side >= 0.0f) return;
+
+    *t_hit = 0.0f;
+    *normal = box.axes[nearest] * side;
+}
+
+f32 sweep_shapes(vec3 from, vec3 delta, f32 radius, collider_shapes_t const &shapes, vec3 *normal)
+{
+    f32 t_hit = 1.0f;
+
+    for (i32 k = 0; k < shapes.num_planes; ++k) {
+        sweep_plane(from, delta, radius, shapes.planes[k], &t_hit, normal);
+    }
+    for (i32 k = 0; k < shapes.num_spheres; ++k) {
+        sphere_shape_t const &sphere = shapes.spheres[k];
+        sweep_point(from, delta, sphere.center, sphere.radius + radius, &t_hit, normal);
+    }
+    for (i32 k = 0; k < shapes.num_capsules; ++k) {
+        sweep_capsule(from, delta, radius, shapes.capsules[k], &t_hit, normal);
+    }
+    for (i32 k = 0; k < shapes.num_boxes; ++k) {
+        sweep_box(from, delta, radius, shapes.boxes[k], &t_hit, normal);
+    }
+
+    return t_hit;
+}
+
+}  // namespace ogp
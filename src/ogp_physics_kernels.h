@@ -0,0 +1,104 @@
+#ifndef OGP_PHYSICS_KERNELS_H
+#define OGP_PHYSICS_KERNELS_H
+
+#include "ogp_defines.h"
+
+namespace ogp
+{
+
+/** Particle columns read and written by Verlet integration.
+ *  Every pointer is a dense column indexed by particle data index.
+ */
+struct verlet_columns_t
+{
+    vec3 const *position_prev {nullptr};
+    vec3 const *position_now {nullptr};
+    vec3 *position_next {nullptr};
+    vec3 *velocity_next {nullptr};
+    vec3 const *force {nullptr};
+    f32 const *mass {nullptr};
+    f32 const *integrate {nullptr};  // 1.0 integrated, 0.0 keeps its next position and velocity
+};
+
+/** Verlet step of particles [begin, end):
+ *  r_next = 2 r_now - r_prev + (force + gravity) * dt^2 / mass
+ *  v_next = (r_next - r_prev) / (2 dt)
+ *  Uses AVX2 or SSE2 when compiled in, scalar loop otherwise.
+ */
+void verlet_integrate(verlet_columns_t const &columns, i32 begin, i32 end, vec3 gravity, f32 dt);
+
+/// Reference scalar version of verlet_integrate().
+void verlet_integrate_scalar(verlet_columns_t const &columns, i32 begin, i32 end, vec3 gravity, f32 dt);
+
+/// Instruction set used by verlet_integrate(): "avx2", "sse2" or "scalar".
+char const *verlet_integrate_isa();
+
+/// Infinite plane, points with dot(normal, p) >= offset are outside.
+struct plane_shape_t
+{
+    vec3 normal;
+    f32 offset;
+};
+
+struct sphere_shape_t
+{
+    vec3 center;
+    f32 radius;
+};
+
+/// Segment [a, b] grown by radius.
+struct capsule_shape_t
+{
+    vec3 a;
+    vec3 b;
+    f32 radius;
+};
+
+/// Oriented box, columns of 'axes' are its unit x, y, z.
+struct box_shape_t
+{
+    vec3 center;
+    mat3 axes;
+    vec3 half_extents;
+};
+
+/// Dense arrays of shapes, one per shape type.
+struct collider_shapes_t
+{
+    plane_shape_t const *planes {nullptr};
+    sphere_shape_t const *spheres {nullptr};
+    capsule_shape_t const *capsules {nullptr};
+    box_shape_t const *boxes {nullptr};
+    i32 num_planes {0};
+    i32 num_spheres {0};
+    i32 num_capsules {0};
+    i32 num_boxes {0};
+};
+
+/// Particle columns read and written by collide_shapes().
+struct collider_columns_t
+{
+    vec3 *position_next {nullptr};
+    f32 const *radius {nullptr};
+    f32 const *inv_mass {nullptr};  // 0.0 never moves
+};
+
+/** Push particles [begin, end) out of shapes, a particle sphere ends touching
+ *  shape surface. One shape at a time over the whole range, so inner loops
+ *  are the same for every particle and without calls.
+ */
+void collide_shapes(collider_columns_t const &columns, i32 begin, i32 end, collider_shapes_t const &shapes);
+
+/** Sweep sphere of 'radius' from 'from' to 'from + delta' against shapes.
+ *  Returns earliest fraction of delta at which it touches a shape and sets
+ *  'normal' to the shape normal there, returns 1.0 when nothing is hit.
+ *  A sphere touching or in a shape and moving deeper is hit at 0.0, it is
+ *  left to collide_shapes() to push out.
+ *  Boxes are grown by radius with square corners, so near corners and
+ *  edges the sphere stops up to 0.73 radius early.
+ */
+f32 sweep_shapes(vec3 from, vec3 delta, f32 radius, collider_shapes_t const &shapes, vec3 *normal);
+
+}  // namespace ogp
+
+#endif  // OGP_PHYSICS_KERNELS_H
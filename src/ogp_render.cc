@@ -38,28 +38,20 @@ vec3 color_t::to_vec3(color_t color)
     return fcolor;
 }
 
-/* .------------------------------.
- * |                              |
- * |        RENDER CONTEXT        |
- * |                              |
- * '------------------------------'
+/* .-------------------------------.
+ * |                               |
+ * |        RENDER RECORDER        |
+ * |                               |
+ * '-------------------------------'
  */
 
-render_context_t::render_context_t ()
+render_recorder_t::render_recorder_t(r_requests_t *requests)
+    : m_requests(requests)
 {
-    m_render_buffer.create_batch(&m_requests);
 }
 
-void render_context_t::reset()
+void render_recorder_t::reset_state()
 {
-    m_requests.points.reset();
-    m_requests.lines.reset();
-    m_requests.color_faces.reset();
-    m_requests.debug_shapes.reset();
-    m_requests.point_lights.reset();
-    m_requests.directional_lights.reset();
-    m_requests.color_meshes.reset();
-
     m_line_color = color_t {0xFF, 0xFF, 0xFF, 0xFF};
     m_fill_color = color_t {0xFF, 0xFF, 0xFF, 0xFF};
 
@@ -68,22 +60,12 @@ void render_context_t::reset()
     m_transform.origin      = vec3{0.0f, 0.0f, 0.0f};
 }
 
-void render_context_t::update_vbo()
-{
-    m_render_buffer.update_vbo(&m_requests);
-}
-
-void render_context_t::render(camera_t const *camera)
-{
-    m_render_buffer.render(camera);
-}
-
-color_t render_context_t::set_line_color(color_t color)
+color_t render_recorder_t::set_line_color(color_t color)
 {
     return set_line_color(color.r, color.g, color.b, color.a);
 }
 
-color_t render_context_t::set_line_color(u8 r, u8 g, u8 b, u8 a)
+color_t render_recorder_t::set_line_color(u8 r, u8 g, u8 b, u8 a)
 {
     color_t prev = m_line_color;
     m_line_color.r = r;
@@ -93,12 +75,12 @@ color_t render_context_t::set_line_color(u8 r, u8 g, u8 b, u8 a)
     return prev;
 }
 
-color_t render_context_t::set_fill_color(color_t color)
+color_t render_recorder_t::set_fill_color(color_t color)
 {
     return set_fill_color(color.r, color.g, color.b, color.a);
 }
 
-color_t render_context_t::set_fill_color(u8 r, u8 g, u8 b, u8 a)
+color_t render_recorder_t::set_fill_color(u8 r, u8 g, u8 b, u8 a)
 {
     color_t prev = m_fill_color;
     m_fill_color.r = r;
@@ -108,28 +90,28 @@ color_t render_context_t::set_fill_color(u8 r, u8 g, u8 b, u8 a)
     return prev;
 }
 
-vec3 render_context_t::set_translation(vec3 translation)
+vec3 render_recorder_t::set_translation(vec3 translation)
 {
     vec3 prev = m_transform.translation;
     m_transform.translation = translation;
     return prev;
 }
 
-vec3 render_context_t::set_rotation(vec3 rotation)
+vec3 render_recorder_t::set_rotation(vec3 rotation)
 {
     vec3 prev = m_transform.rotation;
     m_transform.rotation = rotation;
     return prev;
 }
 
-vec3 render_context_t::set_origin(vec3 origin)
+vec3 render_recorder_t::set_origin(vec3 origin)
 {
     vec3 prev = m_transform.origin;
     m_transform.origin = origin;
     return prev;
 }
 
-void render_context_t::draw_point(vec3 position)
+void render_recorder_t::draw_point(vec3 position)
 {
     rr_point_t rr_point = rr_point_t {};
     rr_point.v.position   = position;
@@ -137,10 +119,10 @@ void render_context_t::draw_point(vec3 position)
 
     rr_point.transform = m_transform;
 
-    m_requests.points.add(rr_point);
+    m_requests->points.add_concurrent(rr_point);
 }
 
-void render_context_t::draw_line(vec3 begin, vec3 end)
+void render_recorder_t::draw_line(vec3 begin, vec3 end)
 {
     rr_line_t rr_line   = rr_line_t{};
     rr_line.v0.position = begin;
@@ -150,10 +132,10 @@ void render_context_t::draw_line(vec3 begin, vec3 end)
 
     rr_line.transform = m_transform;
 
-    m_requests.lines.add(rr_line);
+    m_requests->lines.add_concurrent(rr_line);
 }
 
-void render_context_t::draw_color_face(vec3 p0, vec3 p1, vec3 p2)
+void render_recorder_t::draw_color_face(vec3 p0, vec3 p1, vec3 p2)
 {
     rr_color_face_t rr_color_face = rr_color_face_t {};
 
@@ -167,16 +149,16 @@ void render_context_t::draw_color_face(vec3 p0, vec3 p1, vec3 p2)
 
     rr_color_face.transform = m_transform;
 
-    m_requests.color_faces.add(rr_color_face);
+    m_requests->color_faces.add_concurrent(rr_color_face);
 }
 
-void render_context_t::draw_color_quad(vec3 p0, vec3 p1, vec3 p2, vec3 p3)
+void render_recorder_t::draw_color_quad(vec3 p0, vec3 p1, vec3 p2, vec3 p3)
 {
     draw_color_face(p0, p1, p2);
     draw_color_face(p2, p1, p3);
 }
 
-void render_context_t::draw_cube()
+void render_recorder_t::draw_cube()
 {
     vec3 p0 = vec3 {0.0f, 0.0f, 1.0f};
     vec3 p1 = vec3 {1.0f, 0.0f, 1.0f};
@@ -207,45 +189,126 @@ void render_context_t::draw_cube()
     draw_line(p5, p7);
 }
 
-void render_context_t::draw_color_mesh(mesh_t mesh, transform_t transform)
+void render_recorder_t::draw_color_mesh(mesh_t mesh, transform_t transform)
 {
     rr_color_mesh_t rr_color_mesh {};
     rr_color_mesh.mesh = mesh;
     rr_color_mesh.transform = transform;
 
-    m_requests.color_meshes.add(rr_color_mesh);
+    m_requests->color_meshes.add_concurrent(rr_color_mesh);
 }
 
-void render_context_t::add_point_light(vec3 position, color_t color)
+void render_recorder_t::add_point_light(vec3 position, color_t color)
 {
     rr_point_light_t light {};
     light.position = position;
     light.ambient = color;
     light.diffuse = color;
     light.specular = color;
-    m_requests.point_lights.add(light);
+    m_requests->point_lights.add_concurrent(light);
 
     // debug cube
     rr_debug_shape_t rr_debug_shape {};
     rr_debug_shape.position = position;
     rr_debug_shape.color = color;
-    m_requests.debug_shapes.add(rr_debug_shape);
+    m_requests->debug_shapes.add_concurrent(rr_debug_shape);
 }
 
-void render_context_t::add_directional_light(vec3 direction, color_t color)
+void render_recorder_t::add_directional_light(vec3 direction, color_t color)
 {
     rr_directional_light_t light {};
     light.direction = direction;
     light.ambient = color;
     light.diffuse = color;
     light.specular = color;
-    m_requests.directional_lights.add(light);
+    m_requests->directional_lights.add_concurrent(light);
 
     // debug cube
     rr_debug_shape_t rr_debug_shape {};
     rr_debug_shape.position = vec3 {0.0f, 2.0f, 0.0f};
     rr_debug_shape.color = color;
-    m_requests.debug_shapes.add(rr_debug_shape);
+    m_requests->debug_shapes.add_concurrent(rr_debug_shape);
+}
+
+/* .------------------------------.
+ * |                              |
+ * |        RENDER CONTEXT        |
+ * |                              |
+ * '------------------------------'
+ */
+
+render_context_t::render_context_t ()
+    : render_recorder_t(&m_requests_storage)
+{
+    m_render_buffer.create_batch(&m_requests_storage);
+}
+
+void render_context_t::reset()
+{
+    m_requests_storage.points.reset();
+    m_requests_storage.lines.reset();
+    m_requests_storage.color_faces.reset();
+    m_requests_storage.debug_shapes.reset();
+    m_requests_storage.point_lights.reset();
+    m_requests_storage.directional_lights.reset();
+    m_requests_storage.color_meshes.reset();
+
+    reset_state();
+}
+
+void render_context_t::update_vbo()
+{
+    m_render_buffer.update_vbo(&m_requests_storage);
+}
+
+void render_context_t::render(camera_t const *camera)
+{
+    m_render_buffer.render(camera);
+}
+
+template <typename A>
+static void begin_append(A &requests)
+{
+    requests.begin_append(requests.stats().high_water);
+}
+
+void render_context_t::begin_recording()
+{
+    begin_append(m_requests_storage.points);
+    begin_append(m_requests_storage.lines);
+    begin_append(m_requests_storage.color_faces);
+    begin_append(m_requests_storage.debug_shapes);
+    begin_append(m_requests_storage.point_lights);
+    begin_append(m_requests_storage.directional_lights);
+    begin_append(m_requests_storage.color_meshes);
+}
+
+void render_context_t::end_recording()
+{
+    m_requests_storage.points.end_append();
+    m_requests_storage.lines.end_append();
+    m_requests_storage.color_faces.end_append();
+    m_requests_storage.debug_shapes.end_append();
+    m_requests_storage.point_lights.end_append();
+    m_requests_storage.directional_lights.end_append();
+    m_requests_storage.color_meshes.end_append();
+}
+
+render_recorder_t render_context_t::recorder()
+{
+    return render_recorder_t(&m_requests_storage);
+}
+
+void render_context_t::debug_print_stats(char const *name) const
+{
+    ogp_log_info("render_context_t stats (%s) :", name);
+    m_requests_storage.points.print_stats("points");
+    m_requests_storage.lines.print_stats("lines");
+    m_requests_storage.color_faces.print_stats("color faces");
+    m_requests_storage.debug_shapes.print_stats("debug shapes");
+    m_requests_storage.point_lights.print_stats("point lights");
+    m_requests_storage.directional_lights.print_stats("dir lights");
+    m_requests_storage.color_meshes.print_stats("color meshes");
 }
 
 /* .-----------------------------.
@@ -381,124 +444,140 @@ void render_buffer_t::create_batch(r_requests_t const *r_requests)
 
 void render_buffer_t::update_vbo(r_requests_t const *r_requests)
 {
-    vertices_PC_t vertices_PC;
-    vertices_PNC_t vertices_PNC;
-    std::vector<GLuint> indices_PC;
-    std::vector<GLuint> indices_PNC;
+    using points_t = decltype(r_requests->points);
+    using lines_t = decltype(r_requests->lines);
+    using color_faces_t = decltype(r_requests->color_faces);
+
+    i32 num_points = r_requests->points.size();
+    i32 num_lines = r_requests->lines.size();
+    i32 num_faces = r_requests->color_faces.size();
+
+    // Every request expands to its own range of vertices, so chunks of
+    // requests are expanded on worker threads.
 
-    GLuint index_PC = 0;
-    GLuint index_PNC = 0;
+    vertices_PC_t vertices_PC(num_points + 2 * num_lines);
+    vertices_PNC_t vertices_PNC(3 * num_faces);
+    std::vector<GLuint> indices_PC(vertices_PC.size());
+    std::vector<GLuint> indices_PNC(vertices_PNC.size());
+
+    for (size_t i = 0; i < indices_PC.size(); ++i) indices_PC[i] = i;
+    for (size_t i = 0; i < indices_PNC.size(); ++i) indices_PNC[i] = i;
 
     // VBO POINTS ..............................................................
 
-    for (auto rr_point : r_requests->points) {
+    r_requests->points.parallel_for_chunks([&](points_t::const_iterator first, points_t::const_iterator last) {
+        vertex_PC_t *out = &vertices_PC[first - r_requests->points.begin()];
 
-        vec3 origin = rr_point.transform.origin;
-        vec3 translation = rr_point.transform.translation;
-        vec3 rotation = rr_point.transform.rotation;
+        for (auto it = first; it != last; ++it) {
+            rr_point_t rr_point = *it;
 
-        quat orientation = euler_to_quat(rotation);
-        orientation = glm::normalize(orientation);
+            vec3 origin = rr_point.transform.origin;
+            vec3 translation = rr_point.transform.translation;
+            vec3 rotation = rr_point.transform.rotation;
 
-        vec3 p = rr_point.v.position;
-        p = orientation * (p + translation - origin) + origin;
+            quat orientation = euler_to_quat(rotation);
+            orientation = glm::normalize(orientation);
 
-        rr_point.v.position = p;
+            vec3 p = rr_point.v.position;
+            p = orientation * (p + translation - origin) + origin;
 
-        vertices_PC.push_back(rr_point.v);
-        indices_PC.push_back(index_PC++);
-    }
+            rr_point.v.position = p;
+
+            *out++ = rr_point.v;
+        }
+    }, OGP_RENDER_GRAIN);
 
     m_draw_call_points.mode = GL_POINTS;
-    m_draw_call_points.num_indices = indices_PC.size() - m_draw_call_points.offset;
+    m_draw_call_points.num_indices = num_points;
     m_draw_call_points.offset = 0;
 
     // VBO LINES ...............................................................
 
-    m_draw_call_lines.offset = index_PC;
+    m_draw_call_lines.offset = num_points;
 
-    for (auto rr_line : r_requests->lines) {
+    r_requests->lines.parallel_for_chunks([&](lines_t::const_iterator first, lines_t::const_iterator last) {
+        vertex_PC_t *out = &vertices_PC[num_points + 2 * (first - r_requests->lines.begin())];
 
-        vec3 origin = rr_line.transform.origin;
-        vec3 translation = rr_line.transform.translation;
-        vec3 rotation = rr_line.transform.rotation;
+        for (auto it = first; it != last; ++it) {
+            rr_line_t rr_line = *it;
 
-        quat orientation = euler_to_quat(rotation);
-        orientation = glm::normalize(orientation);
+            vec3 origin = rr_line.transform.origin;
+            vec3 translation = rr_line.transform.translation;
+            vec3 rotation = rr_line.transform.rotation;
 
-        vec3 p0 = rr_line.v0.position;
-        vec3 p1 = rr_line.v1.position;
+            quat orientation = euler_to_quat(rotation);
+            orientation = glm::normalize(orientation);
 
-        p0 = orientation * (p0 + translation - origin) + origin;
-        p1 = orientation * (p1 + translation - origin) + origin;
+            vec3 p0 = rr_line.v0.position;
+            vec3 p1 = rr_line.v1.position;
 
-        rr_line.v0.position = p0;
-        rr_line.v1.position = p1;
+            p0 = orientation * (p0 + translation - origin) + origin;
+            p1 = orientation * (p1 + translation - origin) + origin;
 
-        vertices_PC.push_back(rr_line.v0);
-        vertices_PC.push_back(rr_line.v1);
-        indices_PC.push_back(index_PC++);
-        indices_PC.push_back(index_PC++);
-    }
+            rr_line.v0.position = p0;
+            rr_line.v1.position = p1;
+
+            *out++ = rr_line.v0;
+            *out++ = rr_line.v1;
+        }
+    }, OGP_RENDER_GRAIN);
 
     m_draw_call_lines.mode = GL_LINES;
-    m_draw_call_lines.num_indices = indices_PC.size() - m_draw_call_lines.offset;
+    m_draw_call_lines.num_indices = 2 * num_lines;
 
     // VBO FACES ...............................................................
 
-    m_draw_call_color_faces.offset = index_PNC;
+    m_draw_call_color_faces.offset = 0;
 
-    for (auto rr_face : r_requests->color_faces) {
+    r_requests->color_faces.parallel_for_chunks([&](color_faces_t::const_iterator first, color_faces_t::const_iterator last) {
+        vertex_PNC_t *out = &vertices_PNC[3 * (first - r_requests->color_faces.begin())];
 
-        vec3 origin = rr_face.transform.origin;
-        vec3 translation = rr_face.transform.translation;
-        vec3 rotation = rr_face.transform.rotation;
+        for (auto it = first; it != last; ++it) {
+            rr_color_face_t rr_face = *it;
 
-        quat orientation = euler_to_quat(rotation);
-        orientation = glm::normalize(orientation);
+            vec3 origin = rr_face.transform.origin;
+            vec3 translation = rr_face.transform.translation;
+            vec3 rotation = rr_face.transform.rotation;
 
-        vec3 p0 = rr_face.v0.position;
-        vec3 p1 = rr_face.v1.position;
-        vec3 p2 = rr_face.v2.position;
+            quat orientation = euler_to_quat(rotation);
+            orientation = glm::normalize(orientation);
 
-        p0 = orientation * (p0 + translation - origin) + origin;
-        p1 = orientation * (p1 + translation - origin) + origin;
-        p2 = orientation * (p2 + translation - origin) + origin;
+            vec3 p0 = rr_face.v0.position;
+            vec3 p1 = rr_face.v1.position;
+            vec3 p2 = rr_face.v2.position;
 
-        rr_face.v0.position = p0;
-        rr_face.v1.position = p1;
-        rr_face.v2.position = p2;
+            p0 = orientation * (p0 + translation - origin) + origin;
+            p1 = orientation * (p1 + translation - origin) + origin;
+            p2 = orientation * (p2 + translation - origin) + origin;
 
-        vertex_PNC_t v0;
-        vertex_PNC_t v1;
-        vertex_PNC_t v2;
+            vertex_PNC_t v0;
+            vertex_PNC_t v1;
+            vertex_PNC_t v2;
 
-        v0.position = p0;
-        v1.position = p1;
-        v2.position = p2;
+            v0.position = p0;
+            v1.position = p1;
+            v2.position = p2;
 
-        vec3 a = p1 - p0;
-        vec3 b = p2 - p0;
-        vec3 normal = glm::normalize(glm::cross(a, b));
+            vec3 a = p1 - p0;
+            vec3 b = p2 - p0;
+            vec3 normal = glm::normalize(glm::cross(a, b));
 
-        v0.normal = normal;
-        v1.normal = normal;
-        v2.normal = normal;
+            v0.normal = normal;
+            v1.normal = normal;
+            v2.normal = normal;
 
-        v0.color = rr_face.v0.color;
-        v1.color = rr_face.v1.color;
-        v2.color = rr_face.v2.color;
+            v0.color = rr_face.v0.color;
+            v1.color = rr_face.v1.color;
+            v2.color = rr_face.v2.color;
 
-        vertices_PNC.push_back(v0);
-        vertices_PNC.push_back(v1);
-        vertices_PNC.push_back(v2);
-        indices_PNC.push_back(index_PNC++);
-        indices_PNC.push_back(index_PNC++);
-        indices_PNC.push_back(index_PNC++);
-    }
+            *out++ = v0;
+            *out++ = v1;
+            *out++ = v2;
+        }
+    }, OGP_RENDER_GRAIN);
 
     m_draw_call_color_faces.mode = GL_TRIANGLES;
-    m_draw_call_color_faces.num_indices = indices_PNC.size() - m_draw_call_color_faces.offset;
+    m_draw_call_color_faces.num_indices = 3 * num_faces;
 
     // primitives
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_primitives.EBO);
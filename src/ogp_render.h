@@ -126,18 +126,23 @@ public:
     void render(camera_t const *camera);
 };
 
-/* .------------------------------.
- * |                              |
- * |        RENDER CONTEXT        |
- * |                              |
- * '------------------------------'
+/* .-------------------------------.
+ * |                               |
+ * |        RENDER RECORDER        |
+ * |                               |
+ * '-------------------------------'
  */
 
-class render_context_t
+/** Records draw calls into render requests of a render_context_t.
+ *  Keeps its own colors and transform, so every thread records through
+ *  its own recorder (see render_context_t::recorder()). Recorders of one
+ *  context can run at once between begin_recording() and end_recording().
+ */
+class render_recorder_t
 {
-    render_buffer_t m_render_buffer;
+protected:
 
-    r_requests_t m_requests;
+    r_requests_t *m_requests {nullptr};
 
     color_t m_line_color {0xFF, 0xFF, 0xFF, 0xFF};
 
@@ -145,17 +150,12 @@ class render_context_t
 
     transform_t m_transform;
 
-public:
+    /// Set colors and transform to defaults.
+    void reset_state();
 
-    render_context_t ();
-
-    r_requests_t const &requests_ref() const { return m_requests; }
-
-    void reset();
-
-    void update_vbo();
+public:
 
-    void render(camera_t const *camera);
+    explicit render_recorder_t(r_requests_t *requests);
 
     color_t set_line_color(color_t color);
 
@@ -194,6 +194,49 @@ public:
     void add_point_light(vec3 position, color_t color);
 
     void add_directional_light(vec3 direction, color_t color);
+};
+
+/* .------------------------------.
+ * |                              |
+ * |        RENDER CONTEXT        |
+ * |                              |
+ * '------------------------------'
+ */
+
+class render_context_t : public render_recorder_t
+{
+    render_buffer_t m_render_buffer;
+
+    r_requests_t m_requests_storage;
+
+public:
+
+    render_context_t ();
+
+    r_requests_t const &requests_ref() const { return m_requests_storage; }
+
+    void reset();
+
+    void update_vbo();
+
+    void render(camera_t const *camera);
+
+    // RECORDING ...............................................................
+
+    /** Open render requests for lock free appends from many recorders.
+     *  Each request array reserves room for its high water mark.
+     */
+    void begin_recording();
+
+    /// Publish recorded requests, ones past reserved room are placed here.
+    void end_recording();
+
+    /// New recorder of this context with default colors and transform.
+    render_recorder_t recorder();
+
+    // STATS ...................................................................
+
+    void debug_print_stats(char const *name) const;
 
 };
 /* .-----------------------.
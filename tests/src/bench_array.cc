@@ -0,0 +1,181 @@
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "../catch.hpp"
+
+#include "../../src/ogp_array.h"
+#include "../../src/ogp_physics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace ogp;
+
+using bench_clock_t = std::chrono::steady_clock;
+
+static f32 elapsed_ms(bench_clock_t::time_point begin)
+{
+    std::chrono::duration<f32, std::milli> elapsed = bench_clock_t::now() - begin;
+    return elapsed.count();
+}
+
+template <i32 N>
+static void bench_remove_index()
+{
+    array_t<i32, N> numbers;
+    std::vector<index_t> indices;
+    indices.reserve(N);
+
+    for (i32 i = 0; i < N; ++i) {
+        indices.push_back(numbers.add(i));
+    }
+
+    // remove in random order, so moved elements come from everywhere
+    std::mt19937 rng {1337};
+    std::shuffle(std::begin(indices), std::end(indices), rng);
+
+    auto begin = bench_clock_t::now();
+    for (index_t const &index : indices) {
+        numbers.remove_index(index);
+    }
+    f32 ms = elapsed_ms(begin);
+
+    REQUIRE( numbers.size() == 0 );
+
+    ogp_log_me("remove_index: %8d elements, %10.3f ms, %8.2f Mremoves/s", N, ms, (N / 1000.0f) / ms);
+}
+
+TEST_CASE("bench: array_t remove_index throughput")
+{
+    bench_remove_index<1000>();
+    bench_remove_index<100000>();
+    bench_remove_index<1000000>();
+}
+
+struct bench_item_t
+{
+    f32 values[16] {};
+};
+
+static f32 walk_by_indices(array_t<bench_item_t, 1000000> const &items, std::vector<index_t> const &indices, f32 *ms)
+{
+    auto begin = bench_clock_t::now();
+    f32 sum = 0.0f;
+    for (index_t const &index : indices) {
+        sum += items.get(index)->values[0];
+    }
+    *ms = elapsed_ms(begin);
+    return sum;
+}
+
+TEST_CASE("bench: array_t iteration before and after defragment")
+{
+    constexpr i32 N = 1000000;
+
+    auto items = std::make_unique<array_t<bench_item_t, N>>();
+    std::vector<index_t> indices;
+    std::vector<i64> created;  // creation serial of element behind indices[i]
+    indices.reserve(N);
+    created.reserve(N);
+
+    i64 serial = 0;
+    bench_item_t item {};
+    item.values[0] = 1.0f;
+    for (i32 i = 0; i < N; ++i) {
+        indices.push_back(items->add(item));
+        created.push_back(serial++);
+    }
+
+    // churn: a few rounds of removing and adding back a quarter of elements
+    std::mt19937 rng {1337};
+    std::vector<i32> order(N);
+    for (i32 i = 0; i < N; ++i) order[i] = i;
+
+    for (i32 round = 0; round < 8; ++round) {
+        std::shuffle(std::begin(order), std::end(order), rng);
+        for (i32 i = 0; i < N / 4; ++i) {
+            items->remove_index(indices[order[i]]);
+        }
+        for (i32 i = 0; i < N / 4; ++i) {
+            indices[order[i]] = items->add(item);
+            created[order[i]] = serial++;
+        }
+    }
+
+    // walk in the order the elements were created by the user
+    std::vector<index_t> by_creation(N);
+    for (i32 i = 0; i < N; ++i) order[i] = i;
+    std::sort(std::begin(order), std::end(order), [&created](i32 a, i32 b) {
+        return created[a] < created[b];
+    });
+    for (i32 i = 0; i < N; ++i) {
+        by_creation[i] = indices[order[i]];
+    }
+    indices.swap(by_creation);
+
+    f32 ms_before = 0.0f;
+    f32 ms_after = 0.0f;
+    f32 ms_defragment = 0.0f;
+
+    f32 sum_before = walk_by_indices(*items, indices, &ms_before);
+
+    auto begin = bench_clock_t::now();
+    items->defragment(defrag_order_e::creation);
+    ms_defragment = elapsed_ms(begin);
+
+    f32 sum_after = walk_by_indices(*items, indices, &ms_after);
+
+    REQUIRE( sum_before == sum_after );
+
+    ogp_log_me("walk %d elements by indices: scrambled %.3f ms, defragmented %.3f ms (defragment took %.3f ms)",
+               N, ms_before, ms_after, ms_defragment);
+}
+
+template <i32 N>
+static void bench_snapshot()
+{
+    auto items = std::make_unique<array_t<p_constraint_t, N>>();
+    auto restored = std::make_unique<array_t<p_constraint_t, N>>();
+    std::vector<index_t> indices;
+    indices.reserve(N);
+
+    for (i32 i = 0; i < N; ++i) {
+        indices.push_back(items->add(p_constraint_t {}));
+    }
+    for (i32 i = 0; i < N; i += 7) {
+        items->remove_index(indices[i]);
+    }
+
+    std::vector<u8> buffer;
+    buffer.reserve(N * (sizeof(p_constraint_t) + 32));
+
+    constexpr i32 ROUNDS = 10;
+
+    auto begin = bench_clock_t::now();
+    for (i32 round = 0; round < ROUNDS; ++round) {
+        buffer.clear();
+        items->save(buffer);
+    }
+    f32 ms_save = elapsed_ms(begin) / ROUNDS;
+
+    begin = bench_clock_t::now();
+    for (i32 round = 0; round < ROUNDS; ++round) {
+        size_t offset = 0;
+        restored->restore(buffer, offset);
+    }
+    f32 ms_restore = elapsed_ms(begin) / ROUNDS;
+
+    REQUIRE( restored->size() == items->size() );
+
+    f32 mib = buffer.size() / (1024.0f * 1024.0f);
+    ogp_log_me("snapshot: %8d elements, %8.2f MiB, save %8.3f ms (%7.1f MiB/s), restore %8.3f ms (%7.1f MiB/s)",
+               N, mib, ms_save, mib / ms_save * 1000.0f, ms_restore, mib / ms_restore * 1000.0f);
+}
+
+TEST_CASE("bench: array_t snapshot and restore")
+{
+    bench_snapshot<1024>();
+    bench_snapshot<100000>();
+    bench_snapshot<1000000>();
+}
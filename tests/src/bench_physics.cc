@@ -0,0 +1,799 @@
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "../catch.hpp"
+
+#include "../../src/ogp_cloth.h"
+#include "../../src/ogp_jobs.h"
+#include "../../src/ogp_mesh.h"
+#include "../../src/ogp_physics.h"
+#include "../../src/ogp_physics_broadphase.h"
+#include "../../src/ogp_physics_kernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+using namespace ogp;
+
+#ifndef OGP_ASSETS_DIR
+#define OGP_ASSETS_DIR "assets/"
+#endif
+
+using bench_clock_t = std::chrono::steady_clock;
+
+static f32 elapsed_ms(bench_clock_t::time_point begin)
+{
+    std::chrono::duration<f32, std::milli> elapsed = bench_clock_t::now() - begin;
+    return elapsed.count();
+}
+
+static void bench_cloth_destroy(i32 M, i32 N)
+{
+    physics_t physics;
+    cloth_t cloth {};
+
+    cloth.create(M, N, 1.0f, 1.0f, 0.0f, &physics);
+
+    auto begin = bench_clock_t::now();
+    cloth.destroy(&physics);
+    f32 ms = elapsed_ms(begin);
+
+    REQUIRE( physics.body_exists(cloth.body) == false );
+
+    ogp_log_me("cloth destroy: %3d x %3d, %10.3f ms", M, N, ms);
+}
+
+TEST_CASE("bench: cloth teardown")
+{
+    bench_cloth_destroy(64, 64);
+    bench_cloth_destroy(128, 128);
+    bench_cloth_destroy(256, 256);
+}
+
+static void bench_verlet_kernel(i32 N)
+{
+    std::vector<vec3> position_prev(N);
+    std::vector<vec3> position_now(N);
+    std::vector<vec3> position_next(N);
+    std::vector<vec3> velocity_next(N);
+    std::vector<vec3> force(N);
+    std::vector<f32> mass(N);
+    std::vector<f32> integrate(N);
+
+    for (i32 i = 0; i < N; ++i) {
+        position_prev[i] = vec3 {0.001f * i, 1.0f, -0.002f * i};
+        position_now[i] = position_prev[i] + vec3 {0.01f, -0.02f, 0.0f};
+        force[i] = vec3 {0.0f, 0.0f, 0.1f * (i % 7)};
+        mass[i] = 1.0f + (i % 3);
+        integrate[i] = (i % 13 == 0) ? 0.0f : 1.0f;  // some pinned ones
+    }
+
+    verlet_columns_t columns;
+    columns.position_prev = position_prev.data();
+    columns.position_now = position_now.data();
+    columns.position_next = position_next.data();
+    columns.velocity_next = velocity_next.data();
+    columns.force = force.data();
+    columns.mass = mass.data();
+    columns.integrate = integrate.data();
+
+    vec3 gravity {0.0f, -9.81f, 0.0f};
+    f32 dt = 1.0f / 60.0f;
+    constexpr i32 ROUNDS = 20;
+
+    auto begin = bench_clock_t::now();
+    for (i32 round = 0; round < ROUNDS; ++round) {
+        verlet_integrate_scalar(columns, 0, N, gravity, dt);
+    }
+    f32 ms_scalar = elapsed_ms(begin) / ROUNDS;
+    std::vector<vec3> expected = position_next;
+
+    begin = bench_clock_t::now();
+    for (i32 round = 0; round < ROUNDS; ++round) {
+        verlet_integrate(columns, 0, N, gravity, dt);
+    }
+    f32 ms_simd = elapsed_ms(begin) / ROUNDS;
+
+    REQUIRE( position_next == expected );
+
+    ogp_log_me("verlet kernel: %8d particles, scalar %8.3f ms (%7.1f Mp/s), %-6s %8.3f ms (%7.1f Mp/s)",
+               N, ms_scalar, (N / 1000.0f) / ms_scalar, verlet_integrate_isa(), ms_simd, (N / 1000.0f) / ms_simd);
+}
+
+static void bench_physics_step(i32 N)
+{
+    physics_t physics;
+    body_t body = physics.create_body(body_type_e::body_dynamic);
+
+    for (i32 i = 0; i < N; ++i) {
+        physics.create_particle(body, vec3 {0.001f * i, 1.0f, 0.0f});
+    }
+
+    // integration only
+    physics.set_collisions(false);
+
+    constexpr i32 ROUNDS = 20;
+
+    auto begin = bench_clock_t::now();
+    for (i32 round = 0; round < ROUNDS; ++round) {
+        physics.step(1.0f / 60.0f);
+    }
+    f32 ms = elapsed_ms(begin) / ROUNDS;
+
+    physics.destroy_body(body);
+
+    ogp_log_me("physics step:  %8d particles, %8.3f ms (%7.1f Mp/s)", N, ms, (N / 1000.0f) / ms);
+}
+
+TEST_CASE("bench: Verlet integration")
+{
+    bench_verlet_kernel(10000);
+    bench_verlet_kernel(100000);
+    bench_verlet_kernel(1000000);
+
+    bench_physics_step(10000);
+    bench_physics_step(100000);
+    bench_physics_step(1000000);
+}
+
+static char const *solver_name(solver_e solver)
+{
+    if (solver == solver_e::xpbd) return "xpbd";
+    return (solver == solver_e::jacobi) ? "jacobi" : "gs colored";
+}
+
+static void bench_solver(i32 M, solver_e solver, i32 iterations, i32 steps)
+{
+    physics_t physics;
+    cloth_t cloth {};
+
+    // top row at the height of hook particles, so it starts at rest
+    cloth.create(M, M, 1.0f, 2.0f, 0.0f, &physics);
+    physics.set_solver(solver, iterations);
+    physics.set_collisions(false);
+
+    // first step colors constraints
+    physics.step(1.0f / 60.0f);
+
+    auto begin = bench_clock_t::now();
+    for (i32 i = 0; i < steps; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+    f32 ms = elapsed_ms(begin) / steps;
+
+    f32 error = physics.constraint_error();
+    REQUIRE( error == error );  // not NaN
+
+    ogp_log_me("solver: %3d x %3d, %-10s, %2d iterations, %10.3f ms/step, RMS length error %.6f",
+               M, M, solver_name(solver), iterations, ms, error);
+
+    cloth.destroy(&physics);
+}
+
+TEST_CASE("bench: constraint solvers")
+{
+    // wall time
+    for (i32 M : {64, 128, 256, 512}) {
+        i32 steps = (M < 512) ? 10 : 3;
+        bench_solver(M, solver_e::jacobi, 4, steps);
+        bench_solver(M, solver_e::gauss_seidel_colored, 4, steps);
+    }
+
+    // convergence
+    for (i32 iterations : {1, 2, 4, 8, 16}) {
+        bench_solver(64, solver_e::jacobi, iterations, 30);
+        bench_solver(64, solver_e::gauss_seidel_colored, iterations, 30);
+    }
+}
+
+/// Horizontal rope hung by its first particle, it falls and swings under gravity.
+static void create_rope(physics_t *physics, i32 num, vec3 origin)
+{
+    body_t hook = physics->create_body(body_type_e::body_static);
+    body_t rope = physics->create_body(body_type_e::body_dynamic);
+
+    particle_t hook_particle = physics->create_particle(hook, origin);
+    particle_t prev = physics->create_particle(rope, origin);
+    physics->create_pin(hook, hook_particle, rope, prev);
+
+    for (i32 i = 1; i < num; ++i) {
+        particle_t particle = physics->create_particle(rope, origin + vec3 {0.1f * i, 0.0f, 0.0f});
+        physics->create_constraint(rope, prev, rope, particle);
+        prev = particle;
+    }
+}
+
+TEST_CASE("bench: solver tolerance")
+{
+    // 250 ropes of 32 particles, max 256 iterations
+    for (solver_e solver : {solver_e::jacobi, solver_e::gauss_seidel_colored}) {
+        for (f32 tolerance : {1e-2f, 1e-3f, 1e-4f}) {
+            physics_t physics;
+            for (i32 r = 0; r < 250; ++r) {
+                create_rope(&physics, 32, vec3 {0.0f, 0.0f, 0.01f * r});
+            }
+            physics.set_solver(solver, 256, tolerance);
+            physics.set_collisions(false);
+
+            i32 steps = 30;
+            auto begin = bench_clock_t::now();
+            for (i32 i = 0; i < steps; ++i) {
+                physics.step(1.0f / 60.0f);
+            }
+            f32 ms = elapsed_ms(begin) / steps;
+
+            solver_stats_t const &stats = physics.solver_stats();
+            f32 mean_iterations = static_cast<f32>(stats.num_iterations) / stats.num_steps;
+
+            ogp_log_me("tolerance: %-10s, %.0e, %6.1f iterations/step, %2llu / %2llu converged, %10.3f ms/step, residual max %.6f",
+                       solver_name(solver), tolerance, mean_iterations,
+                       (unsigned long long) stats.num_early_exits, (unsigned long long) stats.num_steps, ms, stats.residual_max);
+        }
+    }
+}
+
+/// Cube of particles at constant density, 'jitter' of cell apart, far from each other at rest.
+static std::vector<vec3> collision_points(i32 N, f32 spacing)
+{
+    std::vector<vec3> points;
+    i32 side = static_cast<i32>(std::ceil(std::cbrt(static_cast<f32>(N))));
+    u32 seed = 7;
+    auto jitter = [&seed, spacing]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (static_cast<f32>(seed >> 8) / static_cast<f32>(1 << 24) - 0.5f) * spacing;
+    };
+
+    for (i32 i = 0; i < N; ++i) {
+        i32 x = i % side;
+        i32 y = (i / side) % side;
+        i32 z = i / (side * side);
+        points.push_back(vec3 {x * spacing + jitter(), y * spacing + jitter(), z * spacing + jitter()});
+    }
+    return points;
+}
+
+static void bench_collisions(i32 N)
+{
+    constexpr i32 ROUNDS = 10;
+    std::vector<vec3> points = collision_points(N, 0.02f);
+
+    // broadphase alone, build and query of every point
+    spatial_hash_t hash;
+    i64 num_pairs = 0;
+    auto begin = bench_clock_t::now();
+    for (i32 round = 0; round < ROUNDS; ++round) {
+        hash.build(points.data(), N, 0.02f);
+        num_pairs = 0;
+        for (i32 i = 0; i < N; ++i) {
+            hash.query(points[i], [&](i32 j) {
+                if (j > i && glm::distance(points[i], points[j]) < 0.02f) num_pairs++;
+            });
+        }
+    }
+    f32 ms_hash = elapsed_ms(begin) / ROUNDS;
+
+    // physics step, with and without collisions
+    physics_t physics;
+    body_t body = physics.create_body(body_type_e::body_dynamic);
+    for (i32 i = 0; i < N; ++i) {
+        particle_t particle = physics.create_particle(body, vec3 {1.0f * i, 0.0f, 0.0f});
+        physics.set_particle_pos(particle, points[i]);
+    }
+
+    f32 ms_step[2] = {};
+    for (i32 collisions = 0; collisions < 2; ++collisions) {
+        physics.set_collisions(collisions == 1);
+        begin = bench_clock_t::now();
+        for (i32 round = 0; round < ROUNDS; ++round) {
+            physics.step(1.0f / 60.0f);
+        }
+        ms_step[collisions] = elapsed_ms(begin) / ROUNDS;
+    }
+
+    physics.destroy_body(body);
+
+    ogp_log_me("collisions: %7d particles, %7lld pairs, hash %8.3f ms (%6.1f ns/p), step %8.3f ms, with collisions %8.3f ms (%6.1f ns/p)",
+               N, (long long) num_pairs, ms_hash, ms_hash * 1e6f / N, ms_step[0], ms_step[1], ms_step[1] * 1e6f / N);
+}
+
+TEST_CASE("bench: particle collisions")
+{
+    for (i32 N : {1000, 10000, 100000}) {
+        bench_collisions(N);
+    }
+}
+
+static void bench_colliders(i32 N)
+{
+    std::vector<vec3> points = collision_points(N, 0.05f);
+    std::vector<vec3> positions(N);
+    std::vector<f32> radius(N, 0.01f);
+    std::vector<f32> inv_mass(N, 1.0f);
+
+    // dozens of shapes around the particle cube
+    f32 side = std::cbrt(static_cast<f32>(N)) * 0.05f;
+    std::vector<plane_shape_t> planes;
+    std::vector<sphere_shape_t> spheres;
+    std::vector<capsule_shape_t> capsules;
+    std::vector<box_shape_t> boxes;
+
+    planes.push_back(plane_shape_t {vec3 {0.0f, 1.0f, 0.0f}, 0.0f});
+    planes.push_back(plane_shape_t {vec3 {1.0f, 0.0f, 0.0f}, 0.0f});
+    planes.push_back(plane_shape_t {vec3 {0.0f, 0.0f, 1.0f}, 0.0f});
+    planes.push_back(plane_shape_t {vec3 {-1.0f, 0.0f, 0.0f}, -side});
+    for (i32 k = 0; k < 16; ++k) {
+        f32 t = (k + 0.5f) / 16.0f * side;
+        spheres.push_back(sphere_shape_t {vec3 {t, 0.5f * side, side - t}, 0.1f * side});
+    }
+    for (i32 k = 0; k < 8; ++k) {
+        f32 t = (k + 0.5f) / 8.0f * side;
+        capsules.push_back(capsule_shape_t {vec3 {t, 0.0f, 0.0f}, vec3 {t, side, side}, 0.05f * side});
+    }
+    for (i32 k = 0; k < 8; ++k) {
+        f32 t = (k + 0.5f) / 8.0f * side;
+        quat orientation = glm::normalize(quat {0.9f, 0.1f * k, 0.2f, 0.0f});
+        boxes.push_back(box_shape_t {vec3 {side - t, t, 0.5f * side}, glm::mat3_cast(orientation), vec3 {0.05f * side}});
+    }
+
+    collider_shapes_t shapes;
+    shapes.planes = planes.data();
+    shapes.spheres = spheres.data();
+    shapes.capsules = capsules.data();
+    shapes.boxes = boxes.data();
+    shapes.num_planes = static_cast<i32>(planes.size());
+    shapes.num_spheres = static_cast<i32>(spheres.size());
+    shapes.num_capsules = static_cast<i32>(capsules.size());
+    shapes.num_boxes = static_cast<i32>(boxes.size());
+    i32 num_shapes = shapes.num_planes + shapes.num_spheres + shapes.num_capsules + shapes.num_boxes;
+
+    collider_columns_t columns;
+    columns.position_next = positions.data();
+    columns.radius = radius.data();
+    columns.inv_mass = inv_mass.data();
+
+    constexpr i32 ROUNDS = 10;
+    f32 ms = 0.0f;
+    for (i32 round = 0; round < ROUNDS; ++round) {
+        positions = points;
+        auto begin = bench_clock_t::now();
+        collide_shapes(columns, 0, N, shapes);
+        ms += elapsed_ms(begin) / ROUNDS;
+    }
+
+    i32 moved = 0;
+    for (i32 i = 0; i < N; ++i) {
+        moved += (positions[i] != points[i]) ? 1 : 0;
+    }
+    REQUIRE( moved > 0 );
+
+    ogp_log_me("colliders: %7d particles, %d shapes, %7d moved, %8.3f ms (%5.2f ns per particle and shape)",
+               N, num_shapes, moved, ms, ms * 1e6f / (static_cast<f32>(N) * num_shapes));
+}
+
+TEST_CASE("bench: colliders")
+{
+    for (i32 N : {1000, 10000, 100000}) {
+        bench_colliders(N);
+    }
+}
+
+static void bench_bvh(char const *name, std::vector<vec3> const &vertices)
+{
+    i32 num_triangles = static_cast<i32>(vertices.size() / 3);
+
+    vec3 lo = vertices[0];
+    vec3 hi = vertices[0];
+    for (vec3 const &v : vertices) {
+        lo = glm::min(lo, v);
+        hi = glm::max(hi, v);
+    }
+    vec3 center = 0.5f * (lo + hi);
+    f32 extent = glm::length(hi - lo);
+
+    constexpr i32 ROUNDS = 5;
+    bvh_t bvh;
+    f32 build_ms = 0.0f;
+    for (i32 round = 0; round < ROUNDS; ++round) {
+        auto begin = bench_clock_t::now();
+        bvh.build(vertices.data(), num_triangles);
+        build_ms += elapsed_ms(begin) / ROUNDS;
+    }
+
+    u32 seed = 4242;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<f32>(seed >> 8) / static_cast<f32>(1 << 24) * 2.0f - 1.0f;
+    };
+
+    // rays from around the mesh towards points inside its bounds
+    constexpr i32 NUM_RAYS = 100000;
+    std::vector<vec3> origins(NUM_RAYS);
+    std::vector<vec3> directions(NUM_RAYS);
+    for (i32 r = 0; r < NUM_RAYS; ++r) {
+        origins[r] = center + extent * glm::normalize(vec3 {random(), random(), random()} + vec3 {0.0f, 1e-3f, 0.0f});
+        vec3 target = center + 0.5f * (hi - lo) * vec3 {random(), random(), random()};
+        directions[r] = glm::normalize(target - origins[r]);
+    }
+
+    i32 num_hits = 0;
+    auto begin = bench_clock_t::now();
+    for (i32 r = 0; r < NUM_RAYS; ++r) {
+        ray_hit_t hit;
+        num_hits += bvh.raycast(origins[r], directions[r], 2.0f * extent, &hit) ? 1 : 0;
+    }
+    f32 ray_ms = elapsed_ms(begin);
+    REQUIRE( num_hits > 0 );
+
+    // particles scattered close to the surface, as a draping cloth
+    constexpr i32 NUM_PARTICLES = 100000;
+    f32 radius = 0.005f * extent;
+    std::vector<vec3> particles(NUM_PARTICLES);
+    for (i32 i = 0; i < NUM_PARTICLES; ++i) {
+        i32 t = static_cast<i32>((random() * 0.5f + 0.5f) * (num_triangles - 1));
+        particles[i] = vertices[3 * t] + 2.0f * radius * vec3 {random(), random(), random()};
+    }
+
+    i32 num_pushed = 0;
+    begin = bench_clock_t::now();
+    for (vec3 &p : particles) {
+        num_pushed += bvh.push_out(&p, radius, p) ? 1 : 0;
+    }
+    f32 push_ms = elapsed_ms(begin);
+    REQUIRE( num_pushed > 0 );
+
+    ogp_log_me("bvh %-8s: %7d triangles, %6d nodes, depth %2d, build %8.3f ms", name, num_triangles, bvh.num_nodes(), bvh.depth(), build_ms);
+    ogp_log_me("bvh %-8s: %7d rays, %6d hits, %6.1f ns per ray", name, NUM_RAYS, num_hits, ray_ms * 1e6f / NUM_RAYS);
+    ogp_log_me("bvh %-8s: %7d particles, %6d pushed, %6.1f ns per particle", name, NUM_PARTICLES, num_pushed, push_ms * 1e6f / NUM_PARTICLES);
+}
+
+/// Wavy height field of 2 * K * K triangles over unit square.
+static std::vector<vec3> terrain_triangles(i32 K)
+{
+    auto height = [K](i32 i, i32 j) {
+        return 0.05f * std::sin(0.3f * i) * std::cos(0.2f * j);
+    };
+    auto vertex = [K, &height](i32 i, i32 j) {
+        return vec3 {static_cast<f32>(i) / K, height(i, j), static_cast<f32>(j) / K};
+    };
+
+    std::vector<vec3> vertices;
+    vertices.reserve(6 * K * K);
+    for (i32 j = 0; j < K; ++j) {
+        for (i32 i = 0; i < K; ++i) {
+            vertices.push_back(vertex(i, j));
+            vertices.push_back(vertex(i, j + 1));
+            vertices.push_back(vertex(i + 1, j + 1));
+            vertices.push_back(vertex(i, j));
+            vertices.push_back(vertex(i + 1, j + 1));
+            vertices.push_back(vertex(i + 1, j));
+        }
+    }
+    return vertices;
+}
+
+TEST_CASE("bench: bvh")
+{
+    bench_bvh("teapot", load_mesh_triangles(OGP_ASSETS_DIR "meshes/teapot.obj"));
+    bench_bvh("terrain", terrain_triangles(256));
+}
+
+/// Box of 8 particles, every pair constrained, returns its body.
+static body_t create_box_body(physics_t *physics, vec3 center, f32 half, std::vector<particle_t> *particles)
+{
+    body_t body = physics->create_body(body_type_e::body_dynamic);
+    i32 first = static_cast<i32>(particles->size());
+
+    for (i32 k = 0; k < 8; ++k) {
+        vec3 corner {(k & 1) ? half : -half, (k & 2) ? half : -half, (k & 4) ? half : -half};
+        particles->push_back(physics->create_particle(body, center + corner));
+    }
+    for (i32 a = 0; a < 8; ++a) {
+        for (i32 b = a + 1; b < 8; ++b) {
+            physics->create_constraint(body, (*particles)[first + a], body, (*particles)[first + b]);
+        }
+    }
+    return body;
+}
+
+/// Mean step time of many cloths and boxes, positions after last step.
+static f32 bench_step_threads(i32 num_threads, std::vector<vec3> *positions)
+{
+    jobs().set_num_threads(num_threads);
+
+    physics_t physics;
+    physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+
+    std::vector<particle_t> particles;
+    for (i32 c = 0; c < 64; ++c) {
+        cloth_t cloth {};
+        cloth.create(32, 32, 1.0f, 1.0f, 2.0f * c, &physics);
+    }
+    for (i32 b = 0; b < 1000; ++b) {
+        create_box_body(&physics, vec3 {0.5f * (b % 40), 0.5f + 0.5f * (b / 40 % 5), -1.0f - 0.5f * (b / 200)}, 0.1f, &particles);
+    }
+
+    constexpr i32 STEPS = 30;
+    auto begin = bench_clock_t::now();
+    for (i32 step = 0; step < STEPS; ++step) {
+        physics.step(1.0f / 60.0f);
+    }
+    f32 ms = elapsed_ms(begin) / STEPS;
+
+    positions->clear();
+    for (particle_t particle : particles) {
+        positions->push_back(physics.get_particle_pos(particle, 1.0f));
+    }
+
+    jobs().set_num_threads(jobs().max_threads());
+    return ms;
+}
+
+TEST_CASE("bench: step scaling")
+{
+    std::vector<vec3> reference;
+    f32 serial_ms = bench_step_threads(1, &reference);
+    ogp_log_me("step scaling: 64 cloths 32 x 32, 1000 boxes, %2d threads, %8.3f ms/step", 1, serial_ms);
+
+    for (i32 threads = 2; threads <= jobs().max_threads(); ++threads) {
+        std::vector<vec3> positions;
+        f32 ms = bench_step_threads(threads, &positions);
+
+        // same result on any number of threads
+        REQUIRE( positions == reference );
+
+        ogp_log_me("step scaling: 64 cloths 32 x 32, 1000 boxes, %2d threads, %8.3f ms/step, speedup %5.2f", threads, ms, serial_ms / ms);
+    }
+}
+
+/// Mean step time of boxes resting on ground, after 'settle' steps.
+static f32 bench_resting_boxes(physics_t *physics, i32 settle, i32 steps)
+{
+    for (i32 step = 0; step < settle; ++step) {
+        physics->step(1.0f / 60.0f);
+    }
+
+    auto begin = bench_clock_t::now();
+    for (i32 step = 0; step < steps; ++step) {
+        physics->step(1.0f / 60.0f);
+    }
+    return elapsed_ms(begin) / steps;
+}
+
+TEST_CASE("bench: sleeping boxes")
+{
+    for (bool sleeping : {false, true}) {
+        physics_t physics;
+        physics.set_sleeping(sleeping);
+        physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+
+        std::vector<particle_t> particles;
+        for (i32 b = 0; b < 200; ++b) {
+            create_box_body(&physics, vec3 {0.5f * (b % 20), 0.11f, 0.5f * (b / 20)}, 0.1f, &particles);
+        }
+
+        f32 ms = bench_resting_boxes(&physics, 300, 100);
+
+        if (sleeping) {
+            REQUIRE( physics.num_sleeping_islands() == 200 );
+        }
+
+        ogp_log_me("sleeping boxes: 200 boxes, sleeping %-3s, %3d / %3d islands asleep, %8.4f ms/step",
+                   sleeping ? "on" : "off", physics.num_sleeping_islands(), physics.num_islands(), ms);
+    }
+
+    // Boxes tied to a kinematic anchor stay awake, cost follows awake rows only
+    f32 all_awake_ms = 0.0f;
+    for (i32 percent : {0, 50, 75, 90, 100}) {
+        physics_t physics;
+        physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+        body_t anchor = physics.create_body(body_type_e::body_kinematic);
+
+        i32 num_boxes = 1000;
+        i32 num_awake = num_boxes * (100 - percent) / 100;
+
+        std::vector<particle_t> particles;
+        for (i32 b = 0; b < num_boxes; ++b) {
+            vec3 center {0.5f * (b % 40), 0.11f, 0.5f * (b / 40)};
+            body_t body = create_box_body(&physics, center, 0.1f, &particles);
+
+            // Awake boxes spread over all rows, not one block of them
+            if (b * num_awake / num_boxes != (b + 1) * num_awake / num_boxes) {
+                particle_t tie = physics.create_particle(anchor, center + vec3 {0.1f, 0.3f, 0.1f});
+                physics.create_constraint(anchor, tie, body, particles.back());
+            }
+        }
+
+        f32 ms = bench_resting_boxes(&physics, 300, 100);
+        if (percent == 0) all_awake_ms = ms;
+
+        REQUIRE( physics.num_sleeping_islands() == num_boxes - num_awake );
+
+        ogp_log_me("sleeping boxes: 1000 boxes, %3d%% asleep, %4d / %4d islands asleep, %8.4f ms/step, %5.2f x all awake",
+                   percent, physics.num_sleeping_islands(), physics.num_islands(), ms, all_awake_ms / ms);
+    }
+}
+
+/// Mean step time of N x N particle grid, springs to right and lower neighbours if 'springs'.
+static f32 bench_spring_grid(i32 N, bool springs, i32 steps)
+{
+    physics_t physics;
+    physics.set_collisions(false);
+    physics.set_sleeping(false);
+
+    body_t body = physics.create_body(body_type_e::body_dynamic);
+    std::vector<particle_t> grid;
+    for (i32 j = 0; j < N; ++j) {
+        for (i32 i = 0; i < N; ++i) {
+            grid.push_back(physics.create_particle(body, vec3 {0.1f * i, 0.0f, 0.1f * j}));
+        }
+    }
+
+    if (springs) {
+        for (i32 j = 0; j < N; ++j) {
+            for (i32 i = 0; i < N; ++i) {
+                if (i + 1 < N) physics.create_spring(body, grid[j * N + i], body, grid[j * N + i + 1], 100.0f, 1.0f);
+                if (j + 1 < N) physics.create_spring(body, grid[j * N + i], body, grid[(j + 1) * N + i], 100.0f, 1.0f);
+            }
+        }
+    }
+
+    physics.step(1.0f / 60.0f);
+
+    auto begin = bench_clock_t::now();
+    for (i32 step = 0; step < steps; ++step) {
+        physics.step(1.0f / 60.0f);
+    }
+    return elapsed_ms(begin) / steps;
+}
+
+TEST_CASE("bench: springs")
+{
+    for (i32 N : {64, 128}) {
+        i32 num_springs = 2 * N * (N - 1);
+        f32 base_ms = bench_spring_grid(N, false, 100);
+        f32 ms = bench_spring_grid(N, true, 100);
+
+        ogp_log_me("springs: %3d x %3d grid, %6d springs, %8.3f ms/step, %8.3f ms/step without, %6.2f ns/spring",
+                   N, N, num_springs, ms, base_ms, 1e6f * (ms - base_ms) / num_springs);
+    }
+}
+
+/// Hanging cloth after 'steps' steps, ms/step and RMS length error.
+static void bench_substeps(i32 M, solver_e solver, i32 iterations, i32 substeps, i32 steps)
+{
+    physics_t physics;
+    cloth_t cloth {};
+
+    cloth.create(M, M, 1.0f, 2.0f, 0.0f, &physics);
+    physics.set_solver(solver, iterations);
+    physics.set_substeps(substeps);
+    physics.set_collisions(false);
+
+    physics.step(1.0f / 60.0f);
+
+    auto begin = bench_clock_t::now();
+    for (i32 i = 0; i < steps; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+    f32 ms = elapsed_ms(begin) / steps;
+
+    f32 error = physics.constraint_error();
+    REQUIRE( error == error );  // not NaN
+
+    ogp_log_me("substeps: %3d x %3d, %-10s, %2d iterations x %2d substeps, %8.3f ms/step, RMS length error %.6f",
+               M, M, solver_name(solver), iterations, substeps, ms, error);
+
+    cloth.destroy(&physics);
+}
+
+TEST_CASE("bench: xpbd substeps")
+{
+    // same number of passes per step, spent on iterations or substeps
+    for (i32 passes : {1, 2, 4, 8, 16}) {
+        bench_substeps(64, solver_e::jacobi, passes, 1, 60);
+        bench_substeps(64, solver_e::gauss_seidel_colored, passes, 1, 60);
+        bench_substeps(64, solver_e::xpbd, passes, 1, 60);
+        bench_substeps(64, solver_e::xpbd, 1, passes, 60);
+    }
+}
+
+TEST_CASE("bench: snapshots")
+{
+    physics_t physics;
+    physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+
+    cloth_t cloth {};
+    cloth.create(64, 64, 1.0f, 2.0f, 0.0f, &physics);
+
+    std::vector<particle_t> particles;
+    for (i32 b = 0; b < 100; ++b) {
+        create_box_body(&physics, vec3 {0.5f * (b % 10), 0.5f, -1.0f - 0.5f * (b / 10)}, 0.1f, &particles);
+    }
+
+    // ring slots grow to world size once
+    for (i32 i = 0; i < OGP_PHYSICS_NUM_SNAPSHOTS; ++i) {
+        physics.save_snapshot();
+        physics.step(1.0f / 60.0f);
+    }
+
+    // every frame saved, as for rollback
+    constexpr i32 STEPS = 100;
+    f32 step_ms = 0.0f;
+    f32 save_ms = 0.0f;
+    for (i32 i = 0; i < STEPS; ++i) {
+        auto begin = bench_clock_t::now();
+        physics.save_snapshot();
+        save_ms += elapsed_ms(begin);
+
+        begin = bench_clock_t::now();
+        physics.step(1.0f / 60.0f);
+        step_ms += elapsed_ms(begin);
+    }
+    u64 hash = physics.state_hash();
+
+    // roll back 10 frames and replay them
+    i64 rollback = physics.frame() - 10;
+    f32 restore_ms = 0.0f;
+    for (i32 i = 0; i < STEPS; ++i) {
+        auto begin = bench_clock_t::now();
+        physics.restore_snapshot(rollback);
+        restore_ms += elapsed_ms(begin);
+    }
+    for (i32 i = 0; i < 10; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+    REQUIRE( physics.state_hash() == hash );
+
+    f32 mb = physics.snapshot_size(rollback) / (1024.0f * 1024.0f);
+
+    ogp_log_me("snapshots: cloth 64 x 64, 100 boxes, %6.3f MB, save %7.4f ms (%5.1f GB/s), restore %7.4f ms (%5.1f GB/s), step %7.3f ms",
+               mb, save_ms / STEPS, mb / save_ms * STEPS, restore_ms / STEPS, mb / restore_ms * STEPS, step_ms / STEPS);
+}
+
+/// One step at 1/30 s of N free particles above thin shapes, ms, 'fast' ones move 1 m.
+static f32 bench_sweeps(i32 N, bool fast)
+{
+    constexpr f32 DT = 1.0f / 30.0f;
+
+    physics_t physics;
+    physics.set_collisions(false);
+
+    physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+    for (i32 k = 0; k < 16; ++k) {
+        vec3 center {(k % 4) * 0.25f, 0.5f, (k / 4) * 0.25f};
+        physics.create_box(center, quat {1.0f, 0.0f, 0.0f, 0.0f}, vec3 {0.1f, 0.005f, 0.1f});
+    }
+    std::vector<vec3> sheet {
+        {0.0f, 0.25f, 0.0f}, {0.0f, 0.25f, 1.0f}, {1.0f, 0.25f, 1.0f},
+        {0.0f, 0.25f, 0.0f}, {1.0f, 0.25f, 1.0f}, {1.0f, 0.25f, 0.0f},
+    };
+    physics.create_triangle_mesh(sheet);
+
+    // radius above gravity drop of one step, so slow ones are not swept
+    body_t body = physics.create_body(body_type_e::body_dynamic);
+    i32 side = static_cast<i32>(std::cbrt(static_cast<f32>(N)));
+    for (i32 i = 0; i < N; ++i) {
+        vec3 position {(i % side) / static_cast<f32>(side), 1.0f + ((i / side) % side) * 0.001f, (i / side / side) / static_cast<f32>(side)};
+        physics.set_particle_radius(physics.create_particle(body, position), 0.02f);
+    }
+    if (fast) physics.add_force(body, {0.0f, -1.0f / (DT * DT), 0.0f});
+
+    auto begin = bench_clock_t::now();
+    physics.step(DT);
+    return elapsed_ms(begin);
+}
+
+TEST_CASE("bench: continuous collisions")
+{
+    for (i32 N : {10000, 100000}) {
+        constexpr i32 ROUNDS = 5;
+        f32 slow_ms = 0.0f;
+        f32 fast_ms = 0.0f;
+        for (i32 round = 0; round < ROUNDS; ++round) {
+            slow_ms += bench_sweeps(N, false) / ROUNDS;
+            fast_ms += bench_sweeps(N, true) / ROUNDS;
+        }
+
+        ogp_log_me("continuous collisions: %6d particles, 18 shapes, %8.3f ms/step slow, %8.3f ms/step all swept (%5.1f ns per swept particle)",
+                   N, slow_ms, fast_ms, 1e6f * (fast_ms - slow_ms) / N);
+    }
+}
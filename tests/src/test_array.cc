@@ -2,6 +2,11 @@
 #include "../catch.hpp"
 
 #include "../../src/ogp_array.h"
+#include "../../src/ogp_array_soa.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
 
 using namespace ogp;
 
@@ -68,15 +73,15 @@ TEST_CASE("Int array remove")
 
     REQUIRE( numbers.size() == 100 );
 
-    // fake indices
+    // fake indices, first use of a slot is its generation 0
     index_t fifth {};
     index_t last {};
 
     fifth.value = 4;
-    fifth.version = 4;
+    fifth.version = 0;
 
     last.value = 99;
-    last.version = 99;
+    last.version = 0;
 
     // check fifth and last element
     REQUIRE( *numbers.get(fifth) == 4 );
@@ -196,7 +201,7 @@ TEST_CASE("Int array add after remove")
 
     index_t user_index;
     user_index.value = 1;
-    user_index.version = 1;
+    user_index.version = 0;
 
     // Remove second element.
     // In this operation fifth element should be moved
@@ -268,3 +273,569 @@ TEST_CASE("array reset by remove_index")
     ogp_log_me("e3 = %d.%d", e3.value, e3.version);
     ogp_log_me("e4 = %d.%d", e4.value, e4.version);
 }
+
+TEST_CASE("array remove keeps other indices valid")
+{
+    array_t<int, 256> numbers;
+    std::vector<index_t> indices;
+
+    for (i32 i = 0; i < 200; ++i) {
+        indices.push_back(numbers.add(i));
+    }
+
+    // remove every third element, from the middle and from the end
+    for (i32 i = 0; i < 200; i += 3) {
+        numbers.remove_index(indices[i]);
+    }
+
+    REQUIRE( numbers.size() == 133 );
+
+    for (i32 i = 0; i < 200; ++i) {
+        if (i % 3 == 0) {
+            REQUIRE( numbers.get(indices[i]) == nullptr );
+        }
+        else {
+            REQUIRE( numbers.get(indices[i]) != nullptr );
+            REQUIRE( *numbers.get(indices[i]) == i );
+        }
+    }
+
+    // reuse freed slots and check again
+    index_t e = numbers.add(1337);
+    REQUIRE( *numbers.get(e) == 1337 );
+    REQUIRE( *numbers.get(indices[199]) == 199 );
+}
+
+TEST_CASE("paged array: pointers are stable while growing")
+{
+    array_t<int, 64, paged_storage_t<int, 16>> numbers;
+
+    index_t first = numbers.add(7);
+    int const *ptr = numbers.get(first);
+
+    std::vector<index_t> indices;
+    for (i32 i = 0; i < 100; ++i) {
+        indices.push_back(numbers.add(i));
+    }
+
+    REQUIRE( numbers.capacity() > 64 );
+    REQUIRE( numbers.get(first) == ptr );
+    REQUIRE( *ptr == 7 );
+
+    numbers.remove_index(indices[10]);
+    REQUIRE( numbers.size() == 100 );
+    REQUIRE( numbers.get(indices[10]) == nullptr );
+    REQUIRE( *numbers.get(indices[99]) == 99 );
+
+    i32 count = 0;
+    i32 sum = 0;
+    for (int n : numbers) {
+        count++;
+        sum += n;
+    }
+    REQUIRE( count == 100 );
+    REQUIRE( sum == 7 + (99 * 100) / 2 - 10 );
+}
+
+TEST_CASE("array_soa_t: add, get, remove")
+{
+    enum : size_t { MASS, POSITION, NAME };
+
+    array_soa_t<8, f32, vec3, char> particles;
+
+    index_t a = particles.add(1.0f, vec3 {1.0f, 0.0f, 0.0f}, 'a');
+    index_t b = particles.add(2.0f, vec3 {2.0f, 0.0f, 0.0f}, 'b');
+    index_t c = particles.add(3.0f, vec3 {3.0f, 0.0f, 0.0f}, 'c');
+
+    REQUIRE( particles.size() == 3 );
+    REQUIRE( *particles.get<MASS>(b) == 2.0f );
+    REQUIRE( particles.get<POSITION>(c)->x == 3.0f );
+
+    particles.remove_index(a);
+
+    REQUIRE( particles.size() == 2 );
+    REQUIRE( particles.get<MASS>(a) == nullptr );
+    REQUIRE( *particles.get<NAME>(b) == 'b' );
+    REQUIRE( *particles.get<NAME>(c) == 'c' );
+
+    // last row was moved to the removed place
+    REQUIRE( particles.column<NAME>()[0] == 'c' );
+}
+
+TEST_CASE("array_soa_t: iterate over chosen columns")
+{
+    enum : size_t { MASS, POSITION, VELOCITY };
+
+    array_soa_t<16, f32, vec3, vec3> particles;
+
+    for (i32 i = 0; i < 20; ++i) {
+        particles.add(1.0f, vec3 {0.0f, 0.0f, 0.0f}, vec3 {1.0f, f32(i), 0.0f});
+    }
+
+    particles.for_each<POSITION, VELOCITY>([](vec3 &position, vec3 const &velocity) {
+        position += velocity;
+    });
+
+    f32 sum = 0.0f;
+    particles.for_each<POSITION>([&sum](vec3 const &position) {
+        sum += position.y;
+    });
+
+    REQUIRE( particles.size() == 20 );
+    REQUIRE( sum == 190.0f );
+}
+
+TEST_CASE("array batch removal keeps order of alive elements")
+{
+    array_t<int, 64> numbers;
+    std::vector<index_t> indices;
+
+    for (i32 i = 0; i < 40; ++i) {
+        indices.push_back(numbers.add(i));
+    }
+
+    std::vector<index_t> to_remove;
+    for (i32 i = 0; i < 40; i += 2) {
+        to_remove.push_back(indices[i]);
+    }
+
+    numbers.mark_removed(to_remove[0]);
+    REQUIRE( numbers.get(indices[0]) == nullptr );
+    REQUIRE( numbers.size() == 40 );  // still in data range until compact()
+
+    numbers.compact();
+    REQUIRE( numbers.size() == 39 );
+
+    numbers.remove_indices(std::vector<index_t>(std::begin(to_remove) + 1, std::end(to_remove)));
+    REQUIRE( numbers.size() == 20 );
+
+    for (i32 i = 0; i < 20; ++i) {
+        REQUIRE( numbers.data_at(i) == 2 * i + 1 );
+    }
+
+    for (i32 i = 1; i < 40; i += 2) {
+        REQUIRE( *numbers.get(indices[i]) == i );
+    }
+
+    // single removal after batch removal still works
+    numbers.remove_index(indices[1]);
+    REQUIRE( numbers.size() == 19 );
+    REQUIRE( *numbers.get(indices[39]) == 39 );
+}
+
+TEST_CASE("array defragment restores slot and creation order")
+{
+    array_t<int, 64> numbers;
+    std::vector<index_t> indices;
+
+    for (i32 i = 0; i < 32; ++i) {
+        indices.push_back(numbers.add(i));
+    }
+
+    // scramble data order with swap removals and slot reuse
+    for (i32 i = 0; i < 32; i += 3) {
+        numbers.remove_index(indices[i]);
+        indices[i] = numbers.add(100 + i);
+    }
+
+    numbers.defragment(defrag_order_e::slot);
+
+    for (i32 i = 0; i < 32; ++i) {
+        REQUIRE( numbers.data_at(i) == *numbers.get(indices[i]) );
+    }
+
+    numbers.defragment(defrag_order_e::creation);
+
+    REQUIRE( numbers.data_at(0) == 1 );
+    REQUIRE( numbers.data_at(31) == 130 );
+
+    numbers.defragment_by([](int n) { return -n; });
+
+    REQUIRE( numbers.data_at(0) == 130 );
+    REQUIRE( *numbers.get(indices[0]) == 100 );
+}
+
+TEST_CASE("array auto defragment after churn")
+{
+    array_t<int, 64> numbers;
+    numbers.set_auto_defragment(0.25f);
+
+    std::vector<index_t> indices;
+    for (i32 i = 0; i < 32; ++i) {
+        indices.push_back(numbers.add(i));
+    }
+
+    for (i32 i = 0; i < 6; ++i) {
+        numbers.remove_index(indices[i]);
+    }
+
+    REQUIRE( numbers.data_at(0) == 31 );  // last element moved to the front
+
+    numbers.remove_index(indices[6]);
+
+    // 7 removals > 0.25 * 25 elements, data is in slot order again
+    for (i32 i = 0; i < 25; ++i) {
+        REQUIRE( numbers.data_at(i) == 7 + i );
+    }
+}
+
+TEST_CASE("index_t is 32 bits and versions wrap around")
+{
+    REQUIRE( sizeof(index_t) == 4 );
+
+    array_t<int, 4> numbers;
+    index_t stale = numbers.add(0);
+    numbers.remove_index(stale);
+
+    // many more adds than handle versions
+    for (i32 i = 0; i < 3 * (OGP_INDEX_VERSION_MAX + 1) + 7; ++i) {
+        index_t index = numbers.add(i);
+        REQUIRE( index.version >= 0 );
+        REQUIRE( *numbers.get(index) == i );
+        numbers.remove_index(index);
+        REQUIRE( numbers.get(index) == nullptr );
+    }
+
+    REQUIRE( numbers.get(stale) == nullptr );
+    REQUIRE( numbers.size() == 0 );
+}
+
+TEST_CASE("index_t stale handle stays stale whatever else is added")
+{
+    // Slot of 'stale' is reused after any number of adds elsewhere
+    for (i32 num_others = 0; num_others < 3 * (OGP_INDEX_VERSION_MAX + 1); ++num_others) {
+        array_t<int, 4> numbers;
+        index_t stale = numbers.add(-1);
+        for (i32 i = 0; i < num_others; ++i) {
+            numbers.add(i);
+        }
+        numbers.remove_index(stale);
+
+        index_t reused = numbers.add(-2);
+        REQUIRE( reused.value == stale.value );
+        REQUIRE( numbers.get(stale) == nullptr );
+        REQUIRE( *numbers.get(reused) == -2 );
+    }
+
+    // Handles from before reset
+    array_t<int, 4> numbers;
+    index_t before = numbers.add(1);
+    numbers.reset();
+    index_t after = numbers.add(2);
+    REQUIRE( numbers.get(before) == nullptr );
+    REQUIRE( *numbers.get(after) == 2 );
+}
+
+TEST_CASE("array growth policies and stats")
+{
+    array_t<int, 4> doubling;
+
+    for (i32 i = 0; i < 5; ++i) {
+        doubling.add(i);
+    }
+
+    REQUIRE( doubling.capacity() == 8 );
+    REQUIRE( doubling.stats().grow_events == 1 );
+    REQUIRE( doubling.stats().high_water == 5 );
+    REQUIRE( doubling.stats().bytes_moved > 0 );
+
+    array_t<int, 4> stepping;
+    stepping.set_growth(growth_e::fixed_step, 3.0f);
+
+    for (i32 i = 0; i < 11; ++i) {
+        stepping.add(i);
+    }
+
+    REQUIRE( stepping.capacity() == 13 );
+    REQUIRE( stepping.stats().grow_events == 3 );
+
+    array_t<int, 4, paged_storage_t<int, 4>> paged;
+
+    for (i32 i = 0; i < 64; ++i) {
+        paged.add(i);
+    }
+
+    paged.remove_index(paged.add(64));
+
+    REQUIRE( paged.stats().high_water == 65 );
+    REQUIRE( paged.size() == 64 );
+}
+
+TEST_CASE("array parallel_for_chunks visits every element once")
+{
+    array_t<i32, 1024> numbers;
+
+    for (i32 i = 0; i < 10000; ++i) {
+        numbers.add(i);
+    }
+
+    numbers.parallel_for_chunks([](array_t<i32, 1024>::iterator first, array_t<i32, 1024>::iterator last) {
+        for (auto it = first; it != last; ++it) {
+            *it = *it * 2;
+        }
+    }, 100);
+
+    std::vector<i64> chunk_sums(100, 0);
+    array_t<i32, 1024> const &const_numbers = numbers;
+    const_numbers.parallel_for_chunks([&](array_t<i32, 1024>::const_iterator first, array_t<i32, 1024>::const_iterator last) {
+        i32 chunk = (first - const_numbers.begin()) / 100;
+        for (auto it = first; it != last; ++it) {
+            chunk_sums[chunk] += *it;
+        }
+    }, 100);
+
+    i64 sum = 0;
+    for (i64 s : chunk_sums) sum += s;
+
+    REQUIRE( sum == 2 * (9999LL * 10000LL / 2) );
+
+    // serial fallback gives the same result
+    jobs().set_serial(true);
+    i64 serial_sum = 0;
+    const_numbers.parallel_for_chunks([&](array_t<i32, 1024>::const_iterator first, array_t<i32, 1024>::const_iterator last) {
+        for (auto it = first; it != last; ++it) {
+            serial_sum += *it;
+        }
+    }, 100);
+    jobs().set_serial(false);
+
+    REQUIRE( serial_sum == sum );
+}
+
+TEST_CASE("array snapshot round trip")
+{
+    array_t<i32, 8> numbers;
+    std::vector<index_t> indices;
+
+    for (i32 i = 0; i < 20; ++i) {
+        indices.push_back(numbers.add(i));
+    }
+    numbers.remove_index(indices[3]);
+    numbers.remove_index(indices[11]);
+    numbers.mark_removed(indices[7]);
+
+    std::vector<u8> buffer;
+    size_t written = numbers.save(buffer);
+
+    REQUIRE( written == buffer.size() );
+
+    array_t<i32, 8> restored;
+    restored.add(100);
+    restored.add(101);
+
+    size_t offset = 0;
+    REQUIRE( restored.restore(buffer, offset) );
+    REQUIRE( offset == buffer.size() );
+
+    REQUIRE( restored.size() == numbers.size() );
+    REQUIRE( restored.capacity() == numbers.capacity() );
+    for (i32 i = 0; i < 20; ++i) {
+        REQUIRE( restored.exists(indices[i]) == numbers.exists(indices[i]) );
+        if (numbers.exists(indices[i])) {
+            REQUIRE( *restored.get(indices[i]) == i );
+        }
+    }
+
+    // both arrays continue the same way
+    restored.compact();
+    numbers.compact();
+    index_t a = numbers.add(50);
+    index_t b = restored.add(50);
+    REQUIRE( a == b );
+    for (i32 i = 0; i < numbers.size(); ++i) {
+        REQUIRE( restored.data_at(i) == numbers.data_at(i) );
+    }
+
+    // several arrays in one buffer, paged storage
+    array_t<i32, 4, paged_storage_t<i32, 4>> paged;
+    for (i32 i = 0; i < 10; ++i) {
+        paged.add(i * 10);
+    }
+    paged.save(buffer);
+
+    array_t<i32, 4, paged_storage_t<i32, 4>> paged_restored;
+    REQUIRE( paged_restored.restore(buffer, offset) );
+    REQUIRE( offset == buffer.size() );
+    for (i32 i = 0; i < 10; ++i) {
+        REQUIRE( paged_restored.data_at(i) == i * 10 );
+    }
+
+    // wrong element type is refused
+    array_t<i64, 8> wrong;
+    offset = 0;
+    REQUIRE_FALSE( wrong.restore(buffer, offset) );
+    REQUIRE( offset == 0 );
+}
+
+TEST_CASE("array_soa_t: snapshot round trip")
+{
+    array_soa_t<4, f32, vec3, i32> particles;
+    std::vector<index_t> indices;
+
+    for (i32 i = 0; i < 10; ++i) {
+        indices.push_back(particles.add(0.5f * i, vec3 {1.0f * i, 2.0f, 3.0f}, 100 + i));
+    }
+    particles.remove_index(indices[2]);
+
+    std::vector<u8> buffer;
+    size_t written = particles.save(buffer);
+    REQUIRE( written == buffer.size() );
+
+    // changed after save, restore brings old rows and handles back
+    particles.remove_index(indices[5]);
+    particles.add(-1.0f, vec3 {0.0f, 0.0f, 0.0f}, -1);
+
+    size_t offset = 0;
+    REQUIRE( particles.restore(buffer, offset) );
+    REQUIRE( offset == buffer.size() );
+    REQUIRE( particles.size() == 9 );
+
+    for (i32 i = 0; i < 10; ++i) {
+        REQUIRE( particles.exists(indices[i]) == (i != 2) );
+        if (i == 2) continue;
+
+        REQUIRE( *particles.get<0>(indices[i]) == 0.5f * i );
+        REQUIRE( particles.get<1>(indices[i])->x == 1.0f * i );
+        REQUIRE( *particles.get<2>(indices[i]) == 100 + i );
+    }
+
+    // element size differs
+    array_soa_t<4, f32, vec3> other;
+    offset = 0;
+    REQUIRE_FALSE( other.restore(buffer, offset) );
+}
+
+TEST_CASE("array concurrent append")
+{
+    array_t<i32, 16> numbers;
+    index_t kept = numbers.add(-1);
+    numbers.remove_index(numbers.add(-2));  // free slot is not used by append
+
+    constexpr i32 NUM_THREADS = 4;
+    constexpr i32 PER_THREAD = 1000;
+
+    numbers.begin_append(NUM_THREADS * PER_THREAD);
+    REQUIRE( numbers.appending() );
+
+    std::vector<std::vector<index_t>> indices(NUM_THREADS);
+    std::vector<std::thread> threads;
+    for (i32 t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&numbers, &indices, t]() {
+            for (i32 i = 0; i < PER_THREAD; ++i) {
+                indices[t].push_back(numbers.add_concurrent(t * PER_THREAD + i));
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    numbers.end_append();
+
+    REQUIRE( numbers.size() == 1 + NUM_THREADS * PER_THREAD );
+    REQUIRE( *numbers.get(kept) == -1 );
+    for (i32 t = 0; t < NUM_THREADS; ++t) {
+        for (i32 i = 0; i < PER_THREAD; ++i) {
+            REQUIRE( *numbers.get(indices[t][i]) == t * PER_THREAD + i );
+        }
+    }
+
+    // plain add goes on after appended ones
+    index_t after = numbers.add(7);
+    REQUIRE( *numbers.get(after) == 7 );
+    REQUIRE( numbers.size() == 2 + NUM_THREADS * PER_THREAD );
+
+    // past reserved room, placed by end_append()
+    array_t<i32, 4> small;
+    small.begin_append(2);
+    std::vector<index_t> small_indices;
+    for (i32 i = 0; i < 6; ++i) {
+        small_indices.push_back(small.add_concurrent(i));
+    }
+    small.end_append();
+
+    REQUIRE( small.size() == 6 );
+    REQUIRE( small.stats().high_water == 6 );
+    for (i32 i = 0; i < 6; ++i) {
+        REQUIRE( *small.get(small_indices[i]) == i );
+    }
+}
+
+TEST_CASE("array reset during append")
+{
+    array_t<i32, 4> numbers;
+    index_t before = numbers.add(-1);
+
+    // three in reserved room, three past capacity
+    numbers.begin_append(2);
+    std::vector<index_t> appended;
+    for (i32 i = 0; i < 6; ++i) {
+        appended.push_back(numbers.add_concurrent(i));
+    }
+    numbers.reset();
+
+    REQUIRE( numbers.appending() == false );
+    REQUIRE( numbers.size() == 0 );
+    REQUIRE( numbers.exists(before) == false );
+    for (index_t index : appended) {
+        REQUIRE( numbers.exists(index) == false );
+    }
+
+    // same slots are taken again, handles from the dropped append stay stale
+    std::vector<index_t> added;
+    for (i32 i = 0; i < 8; ++i) {
+        added.push_back(numbers.add(10 + i));
+    }
+    REQUIRE( numbers.size() == 8 );
+    for (i32 i = 0; i < 8; ++i) {
+        REQUIRE( *numbers.get(added[i]) == 10 + i );
+    }
+    REQUIRE( numbers.exists(before) == false );
+    for (index_t index : appended) {
+        REQUIRE( numbers.exists(index) == false );
+    }
+
+    // next append starts clean, nothing of the dropped one is placed
+    numbers.reset();
+    numbers.begin_append(1);
+    index_t fresh = numbers.add_concurrent(42);
+    numbers.end_append();
+
+    REQUIRE( numbers.size() == 1 );
+    REQUIRE( *numbers.get(fresh) == 42 );
+    REQUIRE( std::vector<i32>(numbers.begin(), numbers.end()) == std::vector<i32> {42} );
+}
+
+TEST_CASE("array concurrent append grows past last frame")
+{
+    // Recorded like render requests, room for as many as the frame before
+    array_t<i32, 8> requests;
+    i32 num_frames = 4;
+
+    for (i32 frame = 0; frame < num_frames; ++frame) {
+        i32 per_thread = 100 << frame;
+        requests.reset();
+        requests.begin_append(requests.stats().high_water);
+
+        std::vector<std::thread> threads;
+        for (i32 t = 0; t < 4; ++t) {
+            threads.emplace_back([&requests, t, per_thread]() {
+                for (i32 i = 0; i < per_thread; ++i) {
+                    requests.add_concurrent(t * per_thread + i);
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        requests.end_append();
+
+        REQUIRE( requests.size() == 4 * per_thread );
+
+        std::vector<i32> values(requests.begin(), requests.end());
+        std::sort(values.begin(), values.end());
+        for (i32 i = 0; i < 4 * per_thread; ++i) {
+            REQUIRE( values[i] == i );
+        }
+    }
+}
@@ -0,0 +1,968 @@
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include "../catch.hpp"
+
+#include "../../src/ogp_cloth.h"
+#include "../../src/ogp_jobs.h"
+#include "../../src/ogp_physics.h"
+#include "../../src/ogp_physics_kernels.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace ogp;
+
+// Count every heap allocation of the test binary
+
+static std::atomic<i64> g_num_allocations {0};
+
+// Kept out of line, when inlined the compiler pairs 'new' of the test with
+// free() below and warns about mismatched allocation functions
+[[gnu::noinline]] static void counted_free(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void *operator new(std::size_t size)
+{
+    g_num_allocations++;
+    void *ptr = std::malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    counted_free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    counted_free(ptr);
+}
+
+/// Particle columns of 'num' rows for verlet_integrate(), values vary with row.
+struct verlet_rows_t
+{
+    std::vector<vec3> position_prev, position_now, position_next, velocity_next, force;
+    std::vector<f32> mass, integrate;
+
+    explicit verlet_rows_t(i32 num)
+    {
+        for (i32 i = 0; i < num; ++i) {
+            f32 f = static_cast<f32>(i);
+            position_prev.push_back(vec3 {0.1f * f, 1.0f - 0.03f * f, -0.2f * f});
+            position_now.push_back(position_prev.back() + vec3 {0.01f, -0.02f * f, 0.005f});
+            position_next.push_back(vec3 {-7.0f});
+            velocity_next.push_back(vec3 {-9.0f});
+            force.push_back(vec3 {std::sin(f), std::cos(f) * 3.0f, 0.5f - 0.1f * f});
+            mass.push_back(0.25f + 0.5f * (i % 5));
+            integrate.push_back((i % 3 == 1) ? 0.0f : 1.0f);
+        }
+    }
+
+    verlet_columns_t columns()
+    {
+        verlet_columns_t c;
+        c.position_prev = position_prev.data();
+        c.position_now = position_now.data();
+        c.position_next = position_next.data();
+        c.velocity_next = velocity_next.data();
+        c.force = force.data();
+        c.mass = mass.data();
+        c.integrate = integrate.data();
+        return c;
+    }
+};
+
+TEST_CASE("verlet kernel matches scalar reference")
+{
+    // Covers the SIMD path this build compiles in, scalar builds compare it with itself
+    INFO( "verlet_integrate_isa() = " << verlet_integrate_isa() );
+
+    vec3 gravity {0.0f, -9.81f, 0.0f};
+    f32 dt = 1.0f / 60.0f;
+
+    // Ranges of any length and start, rows outside stay untouched
+    for (i32 begin : {0, 3}) {
+        for (i32 num = 1; num <= 37; ++num) {
+            i32 rows = begin + num + 8;
+            verlet_rows_t reference(rows);
+            verlet_rows_t simd(rows);
+
+            verlet_integrate_scalar(reference.columns(), begin, begin + num, gravity, dt);
+            verlet_integrate(simd.columns(), begin, begin + num, gravity, dt);
+
+            for (i32 i = 0; i < rows; ++i) {
+                for (i32 axis = 0; axis < 3; ++axis) {
+                    REQUIRE( simd.position_next[i][axis] == Approx(reference.position_next[i][axis]).epsilon(1e-6) );
+                    REQUIRE( simd.velocity_next[i][axis] == Approx(reference.velocity_next[i][axis]).epsilon(1e-5) );
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("physics step does not allocate")
+{
+    physics_t physics;
+    cloth_t cloth {};
+
+    cloth.create(32, 32, 1.0f, 1.0f, 0.0f, &physics);
+
+    physics.step(1.0f / 60.0f);
+
+    i64 before = g_num_allocations;
+    for (i32 i = 0; i < 60; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+    i64 after = g_num_allocations;
+
+    REQUIRE( after - before == 0 );
+
+    cloth.destroy(&physics);
+}
+
+/// Horizontal rope hung by its first particle, it falls and swings under gravity.
+static void create_rope(physics_t *physics, i32 num, vec3 origin)
+{
+    body_t hook = physics->create_body(body_type_e::body_static);
+    body_t rope = physics->create_body(body_type_e::body_dynamic);
+
+    particle_t hook_particle = physics->create_particle(hook, origin);
+    particle_t prev = physics->create_particle(rope, origin);
+    physics->create_pin(hook, hook_particle, rope, prev);
+
+    for (i32 i = 1; i < num; ++i) {
+        particle_t particle = physics->create_particle(rope, origin + vec3 {0.1f * i, 0.0f, 0.0f});
+        physics->create_constraint(rope, prev, rope, particle);
+        prev = particle;
+    }
+}
+
+TEST_CASE("physics solver stops at tolerance")
+{
+    for (solver_e solver : {solver_e::jacobi, solver_e::gauss_seidel_colored, solver_e::xpbd}) {
+        physics_t physics;
+        create_rope(&physics, 16, vec3 {0.0f, 0.0f, 0.0f});
+
+        // without tolerance every pass runs
+        physics.set_solver(solver, 16);
+        physics.step(1.0f / 60.0f);
+        REQUIRE( physics.solver_stats().iterations == 16 );
+        REQUIRE( physics.solver_stats().num_early_exits == 0 );
+
+        physics.set_solver(solver, 1000, 1e-3f);
+        for (i32 i = 0; i < 10; ++i) {
+            physics.step(1.0f / 60.0f);
+
+            solver_stats_t const &stats = physics.solver_stats();
+            REQUIRE( stats.iterations < 1000 );
+            REQUIRE( stats.residual_max <= 1e-3f );
+            REQUIRE( stats.residual_rms <= stats.residual_max );
+        }
+
+        REQUIRE( physics.solver_stats().num_steps == 11 );
+        REQUIRE( physics.solver_stats().num_early_exits == 10 );
+    }
+}
+
+TEST_CASE("physics constraint projection is mass weighted")
+{
+    for (solver_e solver : {solver_e::jacobi, solver_e::gauss_seidel_colored, solver_e::xpbd}) {
+        physics_t physics;
+        physics.set_solver(solver, 1);
+
+        body_t body = physics.create_body(body_type_e::body_dynamic);
+        particle_t light = physics.create_particle(body, {0.0f, 0.0f, 0.0f});
+        particle_t heavy = physics.create_particle(body, {1.0f, 0.0f, 0.0f});
+        physics.create_constraint(body, light, body, heavy);
+
+        // stretched by 1, light one takes 3/4 of correction
+        physics.set_particle_mass(heavy, 3.0f);
+        physics.set_particle_pos(heavy, {2.0f, 0.0f, 0.0f});
+        physics.step(1.0f / 60.0f);
+
+        REQUIRE( physics.get_particle_pos(light, 1.0f).x == Approx(0.75f) );
+        REQUIRE( physics.get_particle_pos(heavy, 1.0f).x == Approx(1.75f) );
+
+        // static particle does not move at all
+        body_t wall = physics.create_body(body_type_e::body_static);
+        particle_t anchor = physics.create_particle(wall, {3.75f, 0.0f, 0.0f});
+        physics.create_constraint(body, heavy, wall, anchor);
+        physics.step(1.0f / 60.0f);
+
+        REQUIRE( physics.get_particle_pos(anchor, 1.0f).x == 3.75f );
+    }
+}
+
+TEST_CASE("spatial hash finds all close pairs")
+{
+    std::vector<vec3> points;
+    u32 seed = 12345;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<f32>(seed >> 8) / static_cast<f32>(1 << 24) * 4.0f - 2.0f;
+    };
+    for (i32 i = 0; i < 2000; ++i) {
+        points.push_back(vec3 {random(), random(), random()});
+    }
+
+    f32 distance = 0.1f;
+    spatial_hash_t hash;
+    hash.build(points.data(), static_cast<i32>(points.size()), distance);
+
+    i32 num = static_cast<i32>(points.size());
+    i32 brute = 0;
+    i32 hashed = 0;
+    for (i32 i = 0; i < num; ++i) {
+        for (i32 j = i + 1; j < num; ++j) {
+            if (glm::distance(points[i], points[j]) < distance) brute++;
+        }
+        hash.query(points[i], [&](i32 j) {
+            if (j > i && glm::distance(points[i], points[j]) < distance) hashed++;
+        });
+    }
+
+    REQUIRE( brute > 0 );
+    REQUIRE( hashed == brute );
+}
+
+TEST_CASE("physics particles collide")
+{
+    physics_t physics;
+
+    body_t body_a = physics.create_body(body_type_e::body_dynamic);
+    body_t body_b = physics.create_body(body_type_e::body_dynamic);
+    particle_t a = physics.create_particle(body_a, {0.0f, 0.0f, 0.0f});
+    particle_t b = physics.create_particle(body_b, {0.01f, 0.0f, 0.0f});
+
+    physics.step(1.0f / 60.0f);
+    f32 d = glm::distance(physics.get_particle_pos(a, 1.0f), physics.get_particle_pos(b, 1.0f));
+    REQUIRE( d == Approx(0.02f) );
+
+    // one body, close at rest, left to constraints
+    body_t body = physics.create_body(body_type_e::body_dynamic);
+    particle_t c = physics.create_particle(body, {1.0f, 0.0f, 0.0f});
+    particle_t e = physics.create_particle(body, {1.01f, 0.0f, 0.0f});
+    physics.step(1.0f / 60.0f);
+    REQUIRE( glm::distance(physics.get_particle_pos(c, 1.0f), physics.get_particle_pos(e, 1.0f)) == Approx(0.01f) );
+
+    // one body, far at rest, self collision
+    particle_t f = physics.create_particle(body, {2.0f, 0.0f, 0.0f});
+    physics.set_particle_pos(f, {1.0f, 0.0f, 0.005f});
+    physics.step(1.0f / 60.0f);
+    REQUIRE( glm::distance(physics.get_particle_pos(c, 1.0f), physics.get_particle_pos(f, 1.0f)) > 0.01f );
+
+    physics.set_collisions(false);
+    physics.set_particle_pos(a, {0.0f, 0.0f, 0.0f});
+    physics.set_particle_pos(b, {0.01f, 0.0f, 0.0f});
+    physics.step(1.0f / 60.0f);
+    REQUIRE( glm::distance(physics.get_particle_pos(a, 1.0f), physics.get_particle_pos(b, 1.0f)) == Approx(0.01f) );
+
+    // points only, nothing to hash
+    physics_t points;
+    particle_t g = points.create_particle(points.create_body(body_type_e::body_dynamic), {0.0f, 0.0f, 0.0f});
+    particle_t h = points.create_particle(points.create_body(body_type_e::body_dynamic), {0.0f, 0.0f, 0.0f});
+    points.set_particle_radius(g, 0.0f);
+    points.set_particle_radius(h, 0.0f);
+    points.step(1.0f / 60.0f);
+    REQUIRE( points.get_particle_pos(g, 1.0f) == points.get_particle_pos(h, 1.0f) );
+}
+
+TEST_CASE("physics particles stay out of colliders")
+{
+    physics_t physics;
+    physics.set_collisions(false);
+
+    body_t body = physics.create_body(body_type_e::body_dynamic);
+    particle_t falling = physics.create_particle(body, {0.0f, 0.5f, 0.0f});
+    particle_t in_sphere = physics.create_particle(body, {5.1f, 0.5f, 0.0f});
+    particle_t in_capsule = physics.create_particle(body, {10.0f, 0.6f, 0.05f});
+    particle_t in_box = physics.create_particle(body, {15.0f, 0.5f, 0.2f});
+
+    physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+    physics.create_sphere({5.0f, 0.5f, 0.0f}, 0.25f);
+    physics.create_capsule({10.0f, 0.5f, -1.0f}, {10.0f, 0.5f, 1.0f}, 0.25f);
+    collider_t box = physics.create_box({15.0f, 0.5f, 0.0f}, quat {1.0f, 0.0f, 0.0f, 0.0f}, {0.25f, 0.25f, 0.25f});
+
+    physics.step(1.0f / 60.0f);
+
+    // touching surfaces, pushed along the shortest way out
+    REQUIRE( glm::distance(physics.get_particle_pos(in_sphere, 1.0f), vec3 {5.0f, 0.5f, 0.0f}) == Approx(0.26f) );
+    REQUIRE( glm::distance(physics.get_particle_pos(in_capsule, 1.0f), vec3 {10.0f, 0.5f, 0.05f}) == Approx(0.26f) );
+    REQUIRE( physics.get_particle_pos(in_box, 1.0f).z == Approx(0.26f) );
+
+    for (i32 i = 0; i < 120; ++i) {
+        physics.step(1.0f / 60.0f);
+        REQUIRE( physics.get_particle_pos(falling, 1.0f).y >= 0.01f - 1e-5f );
+    }
+
+    physics.destroy_collider(box);
+    REQUIRE( physics.collider_exists(box) == false );
+}
+
+TEST_CASE("closest point on triangle")
+{
+    vec3 a {0.0f, 0.0f, 0.0f};
+    vec3 b {1.0f, 0.0f, 0.0f};
+    vec3 c {0.0f, 0.0f, 1.0f};
+
+    // face, vertices and edge regions
+    REQUIRE( (closest_point_on_triangle({0.25f, 1.0f, 0.25f}, a, b, c) == vec3 {0.25f, 0.0f, 0.25f}) );
+    REQUIRE( closest_point_on_triangle({-1.0f, 0.5f, -1.0f}, a, b, c) == a );
+    REQUIRE( closest_point_on_triangle({2.0f, 0.0f, -0.5f}, a, b, c) == b );
+    REQUIRE( closest_point_on_triangle({-0.5f, 0.0f, 2.0f}, a, b, c) == c );
+    REQUIRE( (closest_point_on_triangle({0.5f, -1.0f, -1.0f}, a, b, c) == vec3 {0.5f, 0.0f, 0.0f}) );
+
+    vec3 on_hypotenuse = closest_point_on_triangle({1.0f, 0.0f, 1.0f}, a, b, c);
+    REQUIRE( on_hypotenuse.x == Approx(0.5f) );
+    REQUIRE( on_hypotenuse.z == Approx(0.5f) );
+}
+
+TEST_CASE("bvh queries match brute force")
+{
+    u32 seed = 777;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<f32>(seed >> 8) / static_cast<f32>(1 << 24) * 4.0f - 2.0f;
+    };
+
+    // small triangles scattered in a box
+    std::vector<vec3> vertices;
+    for (i32 i = 0; i < 1000; ++i) {
+        vec3 center {random(), random(), random()};
+        for (i32 k = 0; k < 3; ++k) {
+            vertices.push_back(center + 0.1f * vec3 {random(), random(), random()});
+        }
+    }
+    i32 num_triangles = static_cast<i32>(vertices.size() / 3);
+
+    bvh_t bvh;
+    bvh.build(vertices.data(), num_triangles);
+    REQUIRE( bvh.num_triangles() == num_triangles );
+    REQUIRE( bvh.depth() <= bvh_t::MAX_DEPTH );
+
+    // plane hit inside triangle, the reference
+    auto brute_raycast = [&](vec3 origin, vec3 direction, f32 *best_t) {
+        i32 best = -1;
+        for (i32 t = 0; t < num_triangles; ++t) {
+            vec3 a = vertices[3 * t + 0];
+            vec3 b = vertices[3 * t + 1];
+            vec3 c = vertices[3 * t + 2];
+            vec3 n = glm::cross(b - a, c - a);
+            f32 denom = glm::dot(n, direction);
+            if (std::abs(denom) < 1e-12f) continue;
+            f32 s = glm::dot(n, a - origin) / denom;
+            if (s < 0.0f || s > *best_t) continue;
+            vec3 p = origin + s * direction;
+            bool inside = glm::dot(glm::cross(b - a, p - a), n) >= 0.0f
+                       && glm::dot(glm::cross(c - b, p - b), n) >= 0.0f
+                       && glm::dot(glm::cross(a - c, p - c), n) >= 0.0f;
+            if (inside) {
+                *best_t = s;
+                best = t;
+            }
+        }
+        return best;
+    };
+
+    i32 num_hits = 0;
+    for (i32 r = 0; r < 500; ++r) {
+        vec3 origin {random(), random(), random()};
+        vec3 direction = glm::normalize(vec3 {random(), random(), random()});
+
+        f32 brute_t = 10.0f;
+        i32 brute = brute_raycast(origin, direction, &brute_t);
+
+        ray_hit_t hit;
+        bool found = bvh.raycast(origin, direction, 10.0f, &hit);
+
+        REQUIRE( found == (brute != -1) );
+        if (found) {
+            num_hits++;
+            REQUIRE( hit.triangle == brute );
+            REQUIRE( std::abs(hit.t - brute_t) < 1e-4f );
+            REQUIRE( glm::dot(hit.normal, direction) <= 0.0f );
+        }
+    }
+    REQUIRE( num_hits > 0 );
+
+    // every triangle closer than radius is reported by sphere query
+    f32 radius = 0.2f;
+    for (i32 q = 0; q < 200; ++q) {
+        vec3 center {random(), random(), random()};
+
+        i32 brute = 0;
+        for (i32 t = 0; t < num_triangles; ++t) {
+            vec3 p = closest_point_on_triangle(center, vertices[3 * t + 0], vertices[3 * t + 1], vertices[3 * t + 2]);
+            if (glm::distance(p, center) < radius) brute++;
+        }
+
+        i32 queried = 0;
+        bvh.query_sphere(center, radius, [&](i32 t) {
+            vec3 p = closest_point_on_triangle(center, bvh.vertex(t, 0), bvh.vertex(t, 1), bvh.vertex(t, 2));
+            if (glm::distance(p, center) < radius) queried++;
+        });
+
+        REQUIRE( queried == brute );
+    }
+}
+
+TEST_CASE("physics particles rest on triangle mesh")
+{
+    physics_t physics;
+
+    // floor of two triangles, normals up
+    std::vector<vec3> floor {
+        {-1.0f, 0.0f, -1.0f}, {-1.0f, 0.0f,  1.0f}, { 1.0f, 0.0f,  1.0f},
+        {-1.0f, 0.0f, -1.0f}, { 1.0f, 0.0f,  1.0f}, { 1.0f, 0.0f, -1.0f},
+    };
+    collider_t mesh = physics.create_triangle_mesh(floor);
+
+    body_t body = physics.create_body(body_type_e::body_dynamic);
+    particle_t particle = physics.create_particle(body, {0.3f, 0.15f, -0.2f});
+    physics.set_particle_radius(particle, 0.1f);
+
+    for (i32 i = 0; i < 120; ++i) {
+        physics.step(1.0f / 60.0f);
+        REQUIRE( physics.get_particle_pos(particle, 1.0f).y >= 0.1f - 1e-5f );
+    }
+    REQUIRE( physics.get_particle_pos(particle, 1.0f).y == Approx(0.1f) );
+
+    // center pushed just behind the face in one step, slower than sweeping
+    body_t sunk_body = physics.create_body(body_type_e::body_dynamic);
+    particle_t sunk = physics.create_particle(sunk_body, {-0.5f, 0.04f, 0.5f});
+    physics.set_particle_radius(sunk, 0.1f);
+    physics.add_force(sunk_body, {0.0f, -0.08f * 3600.0f, 0.0f});
+    physics.step(1.0f / 60.0f);
+    REQUIRE( physics.get_particle_pos(sunk, 1.0f).y == Approx(0.1f) );
+
+    // side of face is taken from where center was before
+    bvh_t bvh;
+    bvh.build(floor.data(), 2);
+    vec3 behind {0.3f, -0.02f, -0.2f};
+    REQUIRE( bvh.push_out(&behind, 0.1f, {0.3f, 0.05f, -0.2f}) );
+    REQUIRE( behind.y == Approx(0.1f) );
+    vec3 below {0.3f, 0.02f, -0.2f};
+    REQUIRE( bvh.push_out(&below, 0.1f, {0.3f, -0.05f, -0.2f}) );
+    REQUIRE( below.y == Approx(-0.1f) );
+
+    ray_hit_t hit;
+    collider_t hit_collider {};
+    REQUIRE( physics.raycast({0.5f, 1.0f, 0.5f}, {0.0f, -1.0f, 0.0f}, 2.0f, &hit, &hit_collider) );
+    REQUIRE( hit.t == Approx(1.0f) );
+    REQUIRE( hit.normal.y == Approx(1.0f) );
+    REQUIRE( hit_collider.index == mesh.index );
+    REQUIRE( physics.raycast({0.5f, 1.0f, 0.5f}, {0.0f, 1.0f, 0.0f}, 2.0f, &hit) == false );
+
+    physics.destroy_collider(mesh);
+    REQUIRE( physics.collider_exists(mesh) == false );
+    REQUIRE( physics.raycast({0.5f, 1.0f, 0.5f}, {0.0f, -1.0f, 0.0f}, 2.0f, &hit) == false );
+}
+
+/// Hanging cloths as independent bodies, positions of all particles and state hash after 'num_steps'.
+static std::vector<vec3> simulate_cloths(solver_e solver, i32 num_threads, i32 num_steps, u64 *hash = nullptr)
+{
+    jobs().set_num_threads(num_threads);
+
+    physics_t physics;
+    physics.set_solver(solver, 4);
+    physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+
+    std::vector<particle_t> particles;
+    constexpr i32 N = 24;
+    for (i32 c = 0; c < 8; ++c) {
+        body_t hook = physics.create_body(body_type_e::body_static);
+        body_t body = physics.create_body(body_type_e::body_dynamic);
+        i32 first = static_cast<i32>(particles.size());
+
+        for (i32 j = 0; j < N; ++j) {
+            for (i32 i = 0; i < N; ++i) {
+                vec3 position {1.5f * c + 0.05f * i, 0.5f + 0.05f * j, 0.01f * i};
+                particles.push_back(physics.create_particle(body, position));
+                if (i > 0) physics.create_constraint(body, particles[first + j * N + i - 1], body, particles.back());
+                if (j > 0) physics.create_constraint(body, particles[first + (j - 1) * N + i], body, particles.back());
+            }
+        }
+
+        for (i32 i = 0; i < N; i += 4) {
+            particle_t hook_particle = physics.create_particle(hook, vec3 {1.5f * c + 0.05f * i, 2.0f, 0.0f});
+            physics.create_pin(hook, hook_particle, body, particles[first + (N - 1) * N + i]);
+        }
+    }
+
+    for (i32 step = 0; step < num_steps; ++step) {
+        physics.step(1.0f / 60.0f);
+    }
+
+    std::vector<vec3> positions;
+    for (particle_t particle : particles) {
+        positions.push_back(physics.get_particle_pos(particle, 1.0f));
+    }
+    if (hash != nullptr) *hash = physics.state_hash();
+
+    jobs().set_num_threads(jobs().max_threads());
+    return positions;
+}
+
+TEST_CASE("physics step does not depend on number of threads")
+{
+    for (solver_e solver : {solver_e::jacobi, solver_e::gauss_seidel_colored, solver_e::xpbd}) {
+        u64 hash_one = 0;
+        u64 hash_all = 0;
+        std::vector<vec3> one = simulate_cloths(solver, 1, 30, &hash_one);
+        std::vector<vec3> all = simulate_cloths(solver, jobs().max_threads(), 30, &hash_all);
+
+        // bit for bit
+        REQUIRE( one.size() == all.size() );
+        REQUIRE( one == all );
+        REQUIRE( hash_one == hash_all );
+    }
+}
+
+TEST_CASE("physics state hash catches any difference")
+{
+    physics_t a;
+    physics_t b;
+    REQUIRE( a.state_hash() == b.state_hash() );
+
+    // more than one parallel chunk of particles
+    body_t body_a {};
+    body_t body_b {};
+    std::vector<particle_t> particles_a;
+    std::vector<particle_t> particles_b;
+    for (physics_t *physics : {&a, &b}) {
+        body_t &body = (physics == &a) ? body_a : body_b;
+        std::vector<particle_t> &particles = (physics == &a) ? particles_a : particles_b;
+
+        physics->create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+        body = physics->create_body(body_type_e::body_dynamic);
+        for (i32 i = 0; i < 3000; ++i) {
+            particles.push_back(physics->create_particle(body, vec3 {0.02f * (i % 50), 0.5f + 0.02f * (i / 50), 0.0f}));
+        }
+    }
+
+    // same steps, same hash, every step
+    for (i32 i = 0; i < 30; ++i) {
+        a.step(1.0f / 60.0f);
+        b.step(1.0f / 60.0f);
+        REQUIRE( a.state_hash() == b.state_hash() );
+    }
+
+    // one bit of one particle
+    vec3 pos = a.get_particle_pos(particles_a[2500], 1.0f);
+    pos.x = std::nextafter(pos.x, 1.0f);
+    a.set_particle_pos(particles_a[2500], pos);
+    REQUIRE( a.state_hash() != b.state_hash() );
+
+    b.set_particle_pos(particles_b[2500], pos);
+    REQUIRE( a.state_hash() == b.state_hash() );
+
+    // desync shows in the step it happens
+    a.add_force(body_a, {1e-3f, 0.0f, 0.0f});
+    a.step(1.0f / 60.0f);
+    b.step(1.0f / 60.0f);
+    REQUIRE( a.state_hash() != b.state_hash() );
+}
+
+/// Box of 8 particles, every pair constrained, resting on y = 0. Corners are added to 'particles' if given.
+static body_t create_box_body(physics_t *physics, vec3 center, f32 half, std::vector<particle_t> *particles = nullptr)
+{
+    body_t body = physics->create_body(body_type_e::body_dynamic);
+    std::vector<particle_t> corners;
+
+    for (i32 k = 0; k < 8; ++k) {
+        vec3 corner {(k & 1) ? half : -half, (k & 2) ? half : -half, (k & 4) ? half : -half};
+        corners.push_back(physics->create_particle(body, center + corner));
+    }
+    for (i32 a = 0; a < 8; ++a) {
+        for (i32 b = a + 1; b < 8; ++b) {
+            physics->create_constraint(body, corners[a], body, corners[b]);
+        }
+    }
+    if (particles != nullptr) particles->insert(particles->end(), corners.begin(), corners.end());
+    return body;
+}
+
+TEST_CASE("physics islands sleep and wake")
+{
+    physics_t physics;
+    physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+
+    body_t box_a = create_box_body(&physics, {0.0f, 0.11f, 0.0f}, 0.1f);
+    body_t box_b = create_box_body(&physics, {2.0f, 0.11f, 0.0f}, 0.1f);
+    body_t box_c = create_box_body(&physics, {4.0f, 0.11f, 0.0f}, 0.1f);
+
+    // a and b tied together are one island
+    particle_t a0 = physics.create_particle(box_a, {0.1f, 0.01f, 0.1f});
+    particle_t b0 = physics.create_particle(box_b, {1.9f, 0.01f, 0.1f});
+    physics.create_constraint(box_a, a0, box_b, b0);
+
+    physics.step(1.0f / 60.0f);
+    REQUIRE( physics.num_islands() == 2 );
+    REQUIRE( physics.num_sleeping_islands() == 0 );
+
+    for (i32 i = 0; i < 600 && physics.num_sleeping_islands() < 2; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+    REQUIRE( physics.num_sleeping_islands() == 2 );
+    REQUIRE( physics.body_sleeping(box_a) );
+    REQUIRE( physics.body_sleeping(box_b) );
+    REQUIRE( physics.body_sleeping(box_c) );
+
+    // nothing moves while asleep
+    vec3 rest = physics.get_particle_pos(a0, 1.0f);
+    for (i32 i = 0; i < 10; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+    REQUIRE( physics.get_particle_pos(a0, 1.0f) == rest );
+
+    // force on one body wakes its whole island only
+    physics.add_force(box_b, {0.0f, 50.0f, 0.0f});
+    physics.step(1.0f / 60.0f);
+    REQUIRE( physics.body_sleeping(box_a) == false );
+    REQUIRE( physics.body_sleeping(box_b) == false );
+    REQUIRE( physics.body_sleeping(box_c) );
+
+    // falling particle wakes box it lands on
+    body_t ball = physics.create_body(body_type_e::body_dynamic);
+    particle_t falling = physics.create_particle(ball, {4.1f, 0.5f, 0.1f});
+    physics.set_particle_radius(falling, 0.05f);
+
+    bool woken = false;
+    for (i32 i = 0; i < 60 && !woken; ++i) {
+        physics.step(1.0f / 60.0f);
+        woken = !physics.body_sleeping(box_c);
+    }
+    REQUIRE( woken );
+    REQUIRE( physics.get_particle_pos(falling, 1.0f).y > 0.2f );
+
+    // off wakes everything
+    physics.set_sleeping(false);
+    REQUIRE( physics.body_sleeping(box_c) == false );
+}
+
+TEST_CASE("physics rows defragment at start of step")
+{
+    physics_t physics;
+    physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+
+    std::vector<body_t> boxes;
+    std::vector<particle_t> kept;
+    for (i32 i = 0; i < 16; ++i) {
+        boxes.push_back(create_box_body(&physics, {0.5f * i, 0.11f, 0.0f}, 0.1f, (i % 4 == 0) ? &kept : nullptr));
+    }
+
+    for (i32 i = 0; i < 600 && physics.num_sleeping_islands() < 16; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+    REQUIRE( physics.num_sleeping_islands() == 16 );
+
+    std::vector<vec3> rest;
+    for (particle_t particle : kept) {
+        rest.push_back(physics.get_particle_pos(particle, 1.0f));
+    }
+
+    // three of four boxes go, far more than half the rows of both pools
+    for (i32 i = 0; i < 16; ++i) {
+        if (i % 4 != 0) physics.destroy_body(boxes[i]);
+    }
+
+    // rows move at start of next step, kept boxes sleep on where they were
+    for (i32 i = 0; i < 10; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+    REQUIRE( physics.num_islands() == 4 );
+    REQUIRE( physics.num_sleeping_islands() == 4 );
+    for (size_t k = 0; k < kept.size(); ++k) {
+        REQUIRE( physics.get_particle_pos(kept[k], 1.0f) == rest[k] );
+    }
+
+    // moved rows still belong to their bodies
+    physics.add_force(boxes[4], {0.0f, 50.0f, 0.0f});
+    physics.step(1.0f / 60.0f);
+    REQUIRE( physics.body_sleeping(boxes[0]) );
+    REQUIRE( physics.body_sleeping(boxes[4]) == false );
+    for (size_t k = 0; k < kept.size(); ++k) {
+        bool lifted = k / 8 == 1;
+        REQUIRE( (physics.get_particle_pos(kept[k], 1.0f).y > rest[k].y) == lifted );
+    }
+}
+
+/// Particle of 'mass' hanging on spring from static particle at origin, rest length 1.
+static particle_t create_hanging_spring(physics_t *physics, f32 mass, f32 stiffness, f32 damping, spring_t *spring)
+{
+    body_t anchor = physics->create_body(body_type_e::body_static);
+    body_t bob = physics->create_body(body_type_e::body_dynamic);
+
+    particle_t top = physics->create_particle(anchor, {0.0f, 0.0f, 0.0f});
+    particle_t bottom = physics->create_particle(bob, {0.0f, -1.0f, 0.0f});
+    physics->set_particle_mass(bottom, mass);
+
+    *spring = physics->create_spring(anchor, top, bob, bottom, stiffness, damping);
+    return bottom;
+}
+
+TEST_CASE("physics damped springs settle at rest")
+{
+    f32 const dt = 1.0f / 60.0f;
+    f32 const stiffness = 100.0f;
+
+    // undamped spring keeps swinging, damped one settles where k x = g,
+    // gravity is a force of the same size on every particle
+    physics_t undamped;
+    physics_t damped;
+    spring_t spring_u;
+    spring_t spring_d;
+    particle_t bob_u = create_hanging_spring(&undamped, 2.0f, stiffness, 0.0f, &spring_u);
+    particle_t bob_d = create_hanging_spring(&damped, 2.0f, stiffness, 4.0f, &spring_d);
+
+    f32 rest_y = -1.0f - 9.81f / stiffness;
+    f32 swing_u = 0.0f;
+    f32 swing_d = 0.0f;
+
+    for (i32 i = 0; i < 600; ++i) {
+        undamped.step(dt);
+        damped.step(dt);
+
+        // last second
+        if (i >= 540) {
+            swing_u = std::max(swing_u, std::abs(undamped.get_particle_pos(bob_u, 1.0f).y - rest_y));
+            swing_d = std::max(swing_d, std::abs(damped.get_particle_pos(bob_d, 1.0f).y - rest_y));
+        }
+    }
+
+    REQUIRE( swing_u > 0.05f );
+    REQUIRE( swing_d < 1e-3f );
+    REQUIRE( std::abs(damped.get_particle_pos(bob_d, 1.0f).x) < 1e-6f );
+
+    // without spring it falls
+    damped.destroy_spring(spring_d);
+    REQUIRE( damped.spring_exists(spring_d) == false );
+    for (i32 i = 0; i < 30; ++i) {
+        damped.step(dt);
+    }
+    REQUIRE( damped.get_particle_pos(bob_d, 1.0f).y < rest_y - 0.5f );
+
+    // destroying body takes its springs
+    body_t body = undamped.create_body(body_type_e::body_dynamic);
+    particle_t p = undamped.create_particle(body, {3.0f, 0.0f, 0.0f});
+    particle_t q = undamped.create_particle(body, {4.0f, 0.0f, 0.0f});
+    spring_t spring = undamped.create_spring(body, p, body, q, stiffness, 0.0f);
+    undamped.destroy_body(body);
+    REQUIRE( undamped.spring_exists(spring) == false );
+    REQUIRE( undamped.spring_exists(spring_u) );
+}
+
+/// Mean stretch of constraint holding particle under static one, over 'steps' steps.
+static f32 mean_compliant_stretch(f32 compliance, i32 iterations, i32 substeps, i32 steps)
+{
+    physics_t physics;
+    physics.set_solver(solver_e::xpbd, iterations);
+    physics.set_substeps(substeps);
+
+    body_t anchor = physics.create_body(body_type_e::body_static);
+    body_t bob = physics.create_body(body_type_e::body_dynamic);
+    particle_t top = physics.create_particle(anchor, {0.0f, 0.0f, 0.0f});
+    particle_t bottom = physics.create_particle(bob, {0.0f, -1.0f, 0.0f});
+
+    constraint_t constraint = physics.create_constraint(anchor, top, bob, bottom);
+    physics.set_constraint_compliance(constraint, compliance);
+
+    f32 sum = 0.0f;
+    for (i32 i = 0; i < steps; ++i) {
+        physics.step(1.0f / 60.0f);
+        sum += -1.0f - physics.get_particle_pos(bottom, 1.0f).y;
+    }
+    return sum / steps;
+}
+
+TEST_CASE("physics xpbd stiffness does not depend on iterations")
+{
+    // swings around stretch where length error / compliance equals gravity force
+    f32 const compliance = 1e-2f;
+    f32 expected = compliance * 9.81f;
+
+    for (i32 iterations : {1, 4, 16}) {
+        for (i32 substeps : {1, 4}) {
+            f32 stretch = mean_compliant_stretch(compliance, iterations, substeps, 600);
+            REQUIRE( std::abs(stretch - expected) < 0.05f * expected );
+        }
+    }
+
+    // rigid one hardly stretches
+    REQUIRE( mean_compliant_stretch(0.0f, 1, 1, 600) < 0.05f * expected );
+}
+
+TEST_CASE("physics substeps keep external forces")
+{
+    f32 y[2];
+    i32 k = 0;
+    for (i32 substeps : {1, 8}) {
+        physics_t physics;
+        physics.set_substeps(substeps);
+        REQUIRE( physics.substeps() == substeps );
+
+        body_t body = physics.create_body(body_type_e::body_dynamic);
+        particle_t particle = physics.create_particle(body, {0.0f, 0.0f, 0.0f});
+
+        // force cancels gravity for whole step, no matter how it is split
+        for (i32 i = 0; i < 60; ++i) {
+            physics.set_force(body, {0.0f, 9.81f, 0.0f});
+            physics.step(1.0f / 60.0f);
+        }
+        y[k++] = physics.get_particle_pos(particle, 1.0f).y;
+    }
+
+    REQUIRE( std::abs(y[0]) < 1e-4f );
+    REQUIRE( std::abs(y[1]) < 1e-4f );
+}
+
+TEST_CASE("physics snapshots roll back whole world")
+{
+    physics_t physics;
+    physics.set_num_snapshots(8);
+    physics.create_plane({0.0f, 1.0f, 0.0f}, 0.0f);
+
+    cloth_t cloth {};
+    cloth.create(16, 16, 1.0f, 1.0f, 0.0f, &physics);
+
+    body_t box = create_box_body(&physics, {2.0f, 0.5f, 0.0f}, 0.1f);
+    spring_t spring;
+    particle_t bob = create_hanging_spring(&physics, 1.0f, 50.0f, 0.5f, &spring);
+
+    REQUIRE( physics.restore_snapshot(0) == false );
+
+    // frame 10 saved, frame 20 remembered
+    std::vector<u64> hashes;
+    for (i32 i = 0; i < 20; ++i) {
+        if (physics.frame() == 10) REQUIRE( physics.save_snapshot() == 10 );
+        physics.step(1.0f / 60.0f);
+        hashes.push_back(physics.state_hash());
+    }
+    vec3 bob_20 = physics.get_particle_pos(bob, 1.0f);
+
+    // world changes shape after the snapshot
+    physics.destroy_body(box);
+    physics.destroy_spring(spring);
+    body_t extra = create_box_body(&physics, {-2.0f, 0.5f, 0.0f}, 0.1f);
+    for (i32 i = 0; i < 5; ++i) {
+        physics.step(1.0f / 60.0f);
+    }
+
+    // save and restore do not allocate once ring slot has grown
+    i64 before = g_num_allocations;
+    bool restored = physics.restore_snapshot(10);
+    i64 after = g_num_allocations;
+    REQUIRE( restored );
+    REQUIRE( after - before == 0 );
+
+    REQUIRE( physics.frame() == 10 );
+    REQUIRE( physics.state_hash() == hashes[9] );
+    REQUIRE( physics.body_exists(box) );
+    REQUIRE( physics.body_exists(extra) == false );
+    REQUIRE( physics.spring_exists(spring) );
+
+    // replay is bit for bit the same
+    for (i32 i = 10; i < 20; ++i) {
+        physics.step(1.0f / 60.0f);
+        REQUIRE( physics.state_hash() == hashes[i] );
+    }
+    REQUIRE( physics.get_particle_pos(bob, 1.0f) == bob_20 );
+
+    // ring keeps last 8 frames only
+    for (i32 i = 0; i < 10; ++i) {
+        physics.save_snapshot();
+        physics.step(1.0f / 60.0f);
+    }
+    REQUIRE( physics.restore_snapshot(21) == false );
+    REQUIRE( physics.restore_snapshot(22) );
+
+    before = g_num_allocations;
+    physics.save_snapshot();
+    after = g_num_allocations;
+    REQUIRE( after - before == 0 );
+
+    // later frames are dropped by going back
+    REQUIRE( physics.restore_snapshot(25) == false );
+    REQUIRE( physics.restore_snapshot(22) );
+}
+
+TEST_CASE("physics fast particles do not pass through thin colliders")
+{
+    constexpr f32 DT = 1.0f / 30.0f;
+
+    physics_t physics;
+    physics.set_collisions(false);
+
+    physics.create_box({0.0f, 0.0f, 0.0f}, quat {1.0f, 0.0f, 0.0f, 0.0f}, {0.5f, 0.01f, 0.5f});
+    physics.create_sphere({2.0f, 0.0f, 0.1f}, 0.05f);
+    physics.create_capsule({4.0f, 0.0f, -0.5f}, {4.0f, 0.0f, 0.5f}, 0.02f);
+    std::vector<vec3> sheet {
+        {5.5f, 0.0f, -0.5f}, {5.5f, 0.0f,  0.5f}, {6.5f, 0.0f,  0.5f},
+        {5.5f, 0.0f, -0.5f}, {6.5f, 0.0f,  0.5f}, {6.5f, 0.0f, -0.5f},
+    };
+    physics.create_triangle_mesh(sheet);
+
+    // 2 m in the first step, thinnest shape is 0.02 thick
+    std::vector<particle_t> particles;
+    for (f32 x : {0.0f, 2.0f, 4.0f, 6.0f}) {
+        body_t body = physics.create_body(body_type_e::body_dynamic);
+        particles.push_back(physics.create_particle(body, {x, 1.5f, 0.1f}));
+        physics.add_force(body, {0.0f, -2.0f / (DT * DT), 0.0f});
+    }
+
+    physics.step(DT);
+
+    // stopped at first contact, on top
+    f32 radius = 0.01f;
+    REQUIRE( physics.get_particle_pos(particles[0], 1.0f).y == Approx(0.01f + radius) );
+    REQUIRE( physics.get_particle_pos(particles[3], 1.0f).y == Approx(radius) );
+    REQUIRE( glm::distance(physics.get_particle_pos(particles[1], 1.0f), vec3 {2.0f, 0.0f, 0.1f}) == Approx(0.05f + radius) );
+    REQUIRE( physics.get_particle_pos(particles[2], 1.0f).y > 0.0f );
+
+    for (i32 i = 0; i < 30; ++i) {
+        physics.step(DT);
+        for (particle_t particle : particles) {
+            REQUIRE( physics.get_particle_pos(particle, 1.0f).y > 0.0f );
+        }
+    }
+}
+
+TEST_CASE("physics fast particles leave and slide along colliders")
+{
+    constexpr f32 DT = 1.0f / 30.0f;
+
+    physics_t physics;
+    physics.set_collisions(false);
+
+    // resting on top of a thin box and on a plane
+    physics.create_box({0.0f, 0.0f, 0.0f}, quat {1.0f, 0.0f, 0.0f, 0.0f}, {0.5f, 0.01f, 0.5f});
+    physics.create_plane({0.0f, 1.0f, 0.0f}, -1.0f);
+
+    body_t up_box = physics.create_body(body_type_e::body_dynamic);
+    body_t up_plane = physics.create_body(body_type_e::body_dynamic);
+    body_t slide = physics.create_body(body_type_e::body_dynamic);
+    particle_t leaving_box = physics.create_particle(up_box, {0.0f, 0.02f, 0.0f});
+    particle_t leaving_plane = physics.create_particle(up_plane, {2.0f, -0.99f, 0.0f});
+    particle_t sliding = physics.create_particle(slide, {-0.4f, 0.02f, 0.1f});
+
+    // 1 m up, 0.5 m along the top
+    physics.add_force(up_box, {0.0f, 1.0f / (DT * DT), 0.0f});
+    physics.add_force(up_plane, {0.0f, 1.0f / (DT * DT), 0.0f});
+    physics.add_force(slide, {0.5f / (DT * DT), 0.0f, 0.0f});
+
+    physics.step(DT);
+
+    f32 box_rise = physics.get_particle_pos(leaving_box, 1.0f).y - 0.02f;
+    f32 plane_rise = physics.get_particle_pos(leaving_plane, 1.0f).y + 0.99f;
+    REQUIRE( box_rise > 0.9f );
+    REQUIRE( box_rise == Approx(plane_rise) );
+
+    vec3 slid = physics.get_particle_pos(sliding, 1.0f);
+    REQUIRE( slid.x == Approx(0.1f) );
+    REQUIRE( slid.y == Approx(0.02f) );
+    REQUIRE( slid.z == Approx(0.1f) );
+}